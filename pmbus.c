@@ -0,0 +1,215 @@
+#include <base/oserror.h>
+#include <string.h>
+#include <sys/ioctl.h>
+#include <linux/i2c.h>
+#include <linux/i2c-dev.h>
+#include "hal_utils_inner.h"
+#include "pmbus.h"
+
+// CRC-8 多项式0x07的查表，每字节一次查表，满足多寄存器连续读取的校验开销
+static const uint8_t pmbus_crc8_table[256] = {
+    0x00, 0x07, 0x0e, 0x09, 0x1c, 0x1b, 0x12, 0x15,
+    0x38, 0x3f, 0x36, 0x31, 0x24, 0x23, 0x2a, 0x2d,
+    0x70, 0x77, 0x7e, 0x79, 0x6c, 0x6b, 0x62, 0x65,
+    0x48, 0x4f, 0x46, 0x41, 0x54, 0x53, 0x5a, 0x5d,
+    0xe0, 0xe7, 0xee, 0xe9, 0xfc, 0xfb, 0xf2, 0xf5,
+    0xd8, 0xdf, 0xd6, 0xd1, 0xc4, 0xc3, 0xca, 0xcd,
+    0x90, 0x97, 0x9e, 0x99, 0x8c, 0x8b, 0x82, 0x85,
+    0xa8, 0xaf, 0xa6, 0xa1, 0xb4, 0xb3, 0xba, 0xbd,
+    0xc7, 0xc0, 0xc9, 0xce, 0xdb, 0xdc, 0xd5, 0xd2,
+    0xff, 0xf8, 0xf1, 0xf6, 0xe3, 0xe4, 0xed, 0xea,
+    0xb7, 0xb0, 0xb9, 0xbe, 0xab, 0xac, 0xa5, 0xa2,
+    0x8f, 0x88, 0x81, 0x86, 0x93, 0x94, 0x9d, 0x9a,
+    0x27, 0x20, 0x29, 0x2e, 0x3b, 0x3c, 0x35, 0x32,
+    0x1f, 0x18, 0x11, 0x16, 0x03, 0x04, 0x0d, 0x0a,
+    0x57, 0x50, 0x59, 0x5e, 0x4b, 0x4c, 0x45, 0x42,
+    0x6f, 0x68, 0x61, 0x66, 0x73, 0x74, 0x7d, 0x7a,
+    0x89, 0x8e, 0x87, 0x80, 0x95, 0x92, 0x9b, 0x9c,
+    0xb1, 0xb6, 0xbf, 0xb8, 0xad, 0xaa, 0xa3, 0xa4,
+    0xf9, 0xfe, 0xf7, 0xf0, 0xe5, 0xe2, 0xeb, 0xec,
+    0xc1, 0xc6, 0xcf, 0xc8, 0xdd, 0xda, 0xd3, 0xd4,
+    0x69, 0x6e, 0x67, 0x60, 0x75, 0x72, 0x7b, 0x7c,
+    0x51, 0x56, 0x5f, 0x58, 0x4d, 0x4a, 0x43, 0x44,
+    0x19, 0x1e, 0x17, 0x10, 0x05, 0x02, 0x0b, 0x0c,
+    0x21, 0x26, 0x2f, 0x28, 0x3d, 0x3a, 0x33, 0x34,
+    0x4e, 0x49, 0x40, 0x47, 0x52, 0x55, 0x5c, 0x5b,
+    0x76, 0x71, 0x78, 0x7f, 0x6a, 0x6d, 0x64, 0x63,
+    0x3e, 0x39, 0x30, 0x37, 0x22, 0x25, 0x2c, 0x2b,
+    0x06, 0x01, 0x08, 0x0f, 0x1a, 0x1d, 0x14, 0x13,
+    0xae, 0xa9, 0xa0, 0xa7, 0xb2, 0xb5, 0xbc, 0xbb,
+    0x96, 0x91, 0x98, 0x9f, 0x8a, 0x8d, 0x84, 0x83,
+    0xde, 0xd9, 0xd0, 0xd7, 0xc2, 0xc5, 0xcc, 0xcb,
+    0xe6, 0xe1, 0xe8, 0xef, 0xfa, 0xfd, 0xf4, 0xf3,
+};
+
+uint8_t pmbus_crc8(uint8_t crc, const uint8_t *buf, size_t len)
+{
+    while (len--)
+        crc = pmbus_crc8_table[crc ^ *buf++];
+    return crc;
+}
+
+// PEC 覆盖整个事务: 写地址、命令码、读地址，以及读到的数据
+static uint8_t pmbus_pec(uint8_t slave, uint8_t cmd, const uint8_t *data, size_t len)
+{
+    uint8_t hdr[3] = { slave << 1, cmd, slave << 1 | 1 };
+    return pmbus_crc8(pmbus_crc8(0, hdr, sizeof(hdr)), data, len);
+}
+
+int pmbus_read_word_pec(hal_smbus_t *smb, uint8_t slave, uint8_t cmd, uint16_t *val)
+{
+    ASSERT_FR(smb && val, -OS_EINVAL, "Invalid argument");
+
+    for (int retry = 0; retry < PMBUS_PEC_RETRY; retry++) {
+        uint8_t buf[3] = { 0 };
+        int ret = smb->read_r(smb, slave, cmd, buf, sizeof(buf));
+        if (ret != sizeof(buf))
+            continue;
+        if (pmbus_pec(slave, cmd, buf, 2) != buf[2]) {
+            HAL_DBG("pmbus 0x%x cmd 0x%x pec mismatch, retry", slave, cmd);
+            continue;
+        }
+        *val = buf[0] | buf[1] << 8;
+        return 0;
+    }
+
+    return -1;
+}
+
+int pmbus_read_block_pec(hal_smbus_t *smb, uint8_t slave, uint8_t cmd, uint8_t *buf, int len)
+{
+    ASSERT_FR(smb && buf && len > 0 && len <= PMBUS_BLOCK_MAX, -OS_EINVAL, "Invalid argument");
+
+    for (int retry = 0; retry < PMBUS_PEC_RETRY; retry++) {
+        // 长度字节 + 数据 + PEC
+        uint8_t raw[PMBUS_BLOCK_MAX + 2] = { 0 };
+        int ret = smb->read_r(smb, slave, cmd, raw, len + 2);
+        if (ret != len + 2)
+            continue;
+
+        int count = raw[0];
+        if (count == 0 || count > len)
+            continue;
+        if (pmbus_pec(slave, cmd, raw, count + 1) != raw[count + 1]) {
+            HAL_DBG("pmbus 0x%x cmd 0x%x pec mismatch, retry", slave, cmd);
+            continue;
+        }
+        memcpy(buf, raw + 1, count);
+        return count;
+    }
+
+    return -1;
+}
+
+int pmbus_block_process(int fd, uint8_t slave, uint8_t cmd, const uint8_t *wbuf, int wlen,
+                        uint8_t *rbuf, int rlen, int pec)
+{
+    ASSERT_FR(fd >= 0 && wbuf && rbuf && wlen > 0 && wlen <= PMBUS_BLOCK_MAX &&
+              rlen > 0 && rlen <= PMBUS_BLOCK_MAX, -OS_EINVAL, "Invalid argument");
+
+    // 写: 命令码 + 长度 + 参数; 读: 长度 + 应答 [+ PEC]
+    uint8_t w[PMBUS_BLOCK_MAX + 2] = { cmd, wlen };
+    memcpy(w + 2, wbuf, wlen);
+
+    for (int retry = 0; retry < PMBUS_PEC_RETRY; retry++) {
+        uint8_t r[PMBUS_BLOCK_MAX + 2] = { 0 };
+        struct i2c_msg msgs[2] = {
+            { .addr = slave, .flags = 0, .len = wlen + 2, .buf = w },
+            { .addr = slave, .flags = I2C_M_RD, .len = rlen + 1 + !!pec, .buf = r },
+        };
+        struct i2c_rdwr_ioctl_data xfer = { .msgs = msgs, .nmsgs = 2 };
+        if (ioctl(fd, I2C_RDWR, &xfer) < 0)
+            return -1;
+
+        int count = r[0];
+        if (count == 0 || count > rlen)
+            return -1;
+        if (pec) {
+            // PEC 覆盖写地址、写入的全部字节、读地址和应答
+            uint8_t crc = pmbus_crc8(0, (uint8_t[]){ slave << 1 }, 1);
+            crc = pmbus_crc8(crc, w, wlen + 2);
+            crc = pmbus_crc8(crc, (uint8_t[]){ slave << 1 | 1 }, 1);
+            if (pmbus_crc8(crc, r, count + 1) != r[count + 1]) {
+                HAL_DBG("pmbus 0x%x cmd 0x%x pec mismatch, retry", slave, cmd);
+                continue;
+            }
+        }
+        memcpy(rbuf, r + 1, count);
+        return count;
+    }
+
+    return -1;
+}
+
+int pmbus_query(int fd, uint8_t slave, uint8_t cmd, int pec, uint8_t *q)
+{
+    ASSERT_FR(q, -OS_EINVAL, "Invalid argument");
+
+    int ret = pmbus_block_process(fd, slave, PMBUS_QUERY, &cmd, 1, q, 1, pec);
+    return ret == 1 ? 0 : -1;
+}
+
+int pmbus_coefficients(int fd, uint8_t slave, uint8_t cmd, int pec, pmbus_coef_t *coef)
+{
+    ASSERT_FR(coef, -OS_EINVAL, "Invalid argument");
+
+    // 第二个参数为1表示查询读方向的系数
+    uint8_t w[2] = { cmd, 1 };
+    uint8_t r[5] = { 0 };
+    int ret = pmbus_block_process(fd, slave, PMBUS_COEFFICIENTS, w, sizeof(w), r, sizeof(r), pec);
+    if (ret != sizeof(r))
+        return -1;
+
+    coef->m = (int16_t)(r[0] | r[1] << 8);
+    coef->b = (int16_t)(r[2] | r[3] << 8);
+    coef->R = (int8_t)r[4];
+    return coef->m ? 0 : -1;
+}
+
+double pmbus_linear11(uint16_t raw)
+{
+    // 尾数和指数都是补码
+    int y = raw & 0x7ff;
+    int n = raw >> 11;
+    if (y & 0x400)
+        y -= 1 << 11;
+    if (n & 0x10)
+        n -= 1 << 5;
+
+    double result = y;
+    for (; n > 0; n--)
+        result *= 2.0;
+    for (; n < 0; n++)
+        result *= 0.5;
+    return result;
+}
+
+int pmbus_decode(int fmt, const pmbus_coef_t *coef, uint16_t raw, double *val)
+{
+    ASSERT_FR(val, -OS_EINVAL, "Invalid argument");
+
+    switch (fmt) {
+    case PMBUS_FMT_LINEAR:
+        *val = pmbus_linear11(raw);
+        return 0;
+    case PMBUS_FMT_SIGNED:
+        *val = (int16_t)raw;
+        return 0;
+    case PMBUS_FMT_U8:
+        *val = raw & 0xff;
+        return 0;
+    case PMBUS_FMT_DIRECT: {
+        if (!coef || !coef->m)
+            return -1;
+        double y = (int16_t)raw;
+        for (int r = coef->R; r > 0; r--)
+            y /= 10;
+        for (int r = coef->R; r < 0; r++)
+            y *= 10;
+        *val = (y - coef->b) / coef->m;
+        return 0;
+    }
+    default:
+        return -1;
+    }
+}
@@ -0,0 +1,122 @@
+#ifndef __SXF_PMBUS_H__
+#define __SXF_PMBUS_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal_utils.h"
+
+#define PMBUS_PEC_RETRY     3       // PEC校验失败时单个事务的重试次数
+#define PMBUS_BLOCK_MAX     32      // SMBus block 最大长度
+
+#define PMBUS_QUERY         0x1a
+#define PMBUS_COEFFICIENTS  0x30
+#define PMBUS_STATUS_BYTE   0x78
+#define PMBUS_STATUS_WORD   0x79
+#define PMBUS_STATUS_FANS   0x82    // STATUS_FANS_3_4 的下一个命令
+#define PMBUS_READ_POUT     0x96
+#define PMBUS_READ_PIN      0x97
+#define PMBUS_REVISION      0x98
+#define PMBUS_IS_STATUS(_cmd) ((_cmd) >= PMBUS_STATUS_BYTE && (_cmd) < PMBUS_STATUS_FANS)
+
+// QUERY 的应答
+#define PMBUS_QUERY_SUPPORTED   HAL_BIT(7)
+#define PMBUS_QUERY_READ        HAL_BIT(5)
+#define PMBUS_QUERY_FMT(_q)     (((_q) >> 2) & 0x7)
+
+// 数据格式，与 QUERY 应答中的编码一致
+typedef enum {
+    PMBUS_FMT_LINEAR = 0,   // 5位指数 + 11位尾数
+    PMBUS_FMT_SIGNED = 1,   // 16位有符号数
+    PMBUS_FMT_DIRECT = 3,   // 按 COEFFICIENTS 换算
+    PMBUS_FMT_U8 = 4,       // 8位无符号数
+    PMBUS_FMT_VID = 5,
+    PMBUS_FMT_MFR = 6,      // 厂商自定义
+    PMBUS_FMT_NONE = 7,     // 不是数值
+} pmbus_fmt_e;
+
+// 直接格式系数: X = (Y * 10^-R - b) / m
+typedef struct {
+    int16_t m;
+    int16_t b;
+    int8_t R;
+} pmbus_coef_t;
+
+/**
+ * @description: 计算SMBus PEC(CRC-8, 多项式 x^8+x^2+x+1)，查表实现
+ * @param {uint8_t} crc: 初始值，分段计算时传入上一段的结果，第一段为0
+ * @param {const uint8_t*} buf: 数据
+ * @param {size_t} len: 数据长度
+ * @return {uint8_t} crc
+ */
+uint8_t pmbus_crc8(uint8_t crc, const uint8_t *buf, size_t len);
+/**
+ * @description: 带PEC校验读取一个word，校验失败只重试这一个事务
+ * @param {hal_smbus_t*} smb: 总线
+ * @param {uint8_t} slave: 设备地址
+ * @param {uint8_t} cmd: 命令码
+ * @param {uint16_t*} val: 读到的值
+ * @return {int} 成功: 0, 失败: -1
+ */
+int pmbus_read_word_pec(hal_smbus_t *smb, uint8_t slave, uint8_t cmd, uint16_t *val);
+/**
+ * @description: 带PEC校验读取block，校验失败只重试这一个事务
+ * @param {hal_smbus_t*} smb: 总线
+ * @param {uint8_t} slave: 设备地址
+ * @param {uint8_t} cmd: 命令码
+ * @param {uint8_t*} buf: 数据，不含长度字节
+ * @param {int} len: buf 长度
+ * @return {int} 成功: 读到的字节数, 失败: -1
+ */
+int pmbus_read_block_pec(hal_smbus_t *smb, uint8_t slave, uint8_t cmd, uint8_t *buf, int len);
+/**
+ * @description: SMBus block write-block read process call，用于 QUERY/COEFFICIENTS 这类先写参数再读应答的命令
+ *               hal_smbus_t 没有该事务，直接在i2c设备上用 I2C_RDWR 发出
+ * @param {int} fd: 打开的i2c设备
+ * @param {uint8_t} slave: 设备地址
+ * @param {uint8_t} cmd: 命令码
+ * @param {const uint8_t*} wbuf: 写入的参数，不含长度字节
+ * @param {int} wlen: 参数长度
+ * @param {uint8_t*} rbuf: 应答数据，不含长度字节
+ * @param {int} rlen: 期望的应答长度
+ * @param {int} pec: 是否校验PEC
+ * @return {int} 成功: 应答的字节数, 失败: -1
+ */
+int pmbus_block_process(int fd, uint8_t slave, uint8_t cmd, const uint8_t *wbuf, int wlen,
+                        uint8_t *rbuf, int rlen, int pec);
+/**
+ * @description: 通过 QUERY 查询设备是否支持某个命令及其数据格式
+ * @param {int} fd: 打开的i2c设备
+ * @param {uint8_t} slave: 设备地址
+ * @param {uint8_t} cmd: 被查询的命令码
+ * @param {int} pec: 是否校验PEC
+ * @param {uint8_t*} q: QUERY 应答，用 PMBUS_QUERY_* 解析
+ * @return {int} 成功: 0, 设备不支持 QUERY 或读取失败: -1
+ */
+int pmbus_query(int fd, uint8_t slave, uint8_t cmd, int pec, uint8_t *q);
+/**
+ * @description: 通过 COEFFICIENTS 读取某个读命令的直接格式系数
+ * @param {int} fd: 打开的i2c设备
+ * @param {uint8_t} slave: 设备地址
+ * @param {uint8_t} cmd: 读命令码
+ * @param {int} pec: 是否校验PEC
+ * @param {pmbus_coef_t*} coef: 输出的系数
+ * @return {int} 成功: 0, 失败: -1
+ */
+int pmbus_coefficients(int fd, uint8_t slave, uint8_t cmd, int pec, pmbus_coef_t *coef);
+/**
+ * @description: 解码 LINEAR11 格式
+ * @param {uint16_t} raw: 读到的word
+ * @return {double} 数值
+ */
+double pmbus_linear11(uint16_t raw);
+/**
+ * @description: 按数据格式解码读到的word
+ * @param {int} fmt: pmbus_fmt_e
+ * @param {const pmbus_coef_t*} coef: 直接格式的系数，其它格式可以为NULL
+ * @param {uint16_t} raw: 读到的word
+ * @param {double*} val: 数值
+ * @return {int} 成功: 0, 格式无法解码: -1
+ */
+int pmbus_decode(int fmt, const pmbus_coef_t *coef, uint16_t raw, double *val);
+
+#endif
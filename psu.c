@@ -1,177 +1,949 @@
-#include <base/oserror.h>
-#include <stdlib.h>
-#include <stdio.h>
-#include "hal_utils_inner.h"
-#include "hal_hwinfo.h"
-#include "psu.h"
-
-#define family_ok(_f1, _f2)                                                \
-    ({                                                                     \
-        int _ok = 0;                                                       \
-        const char *str = hal_get_hwinfo(_f2) ?: "";                       \
-        if (_f1 == NULL || _f1[0] == '\0' || !strcmp(_f1, HAL_FAMILY_ALL)) \
-            _ok = 1;                                                       \
-        else if (!strcmp(_f1, str))                                        \
-            _ok = 1;                                                       \
-        _ok;                                                               \
-    })
-
-static bool family_match(hal_family_t *family)
-{
-    if (!family_ok(family->vendor, HAL_DATA_HW_VENDOR))
-        return false;
-    if (!family_ok(family->platform, HAL_DATA_HW_PLATFORM))
-        return false;
-    if (!family_ok(family->model, HAL_DATA_HW_MODEL))
-        return false;
-    return true;
-}
-
-static bool product_model_match(const char *model)
-{
-    const char *str = hal_get_hwinfo(HAL_DATA_HW_PRODUCT_MODEL);
-    return strcmp(str, model) == 0;
-}
-
-#define PSU_MATCH_TABLE_MAX 32
-static psu_match_t *psu_match_table[PSU_MATCH_TABLE_MAX];
-static int psu_match_table_size;
-
-void psu_register(psu_match_t *match, int size)
-{
-    for (int i = 0; i < size; i++) {
-        if (psu_match_table_size >= PSU_MATCH_TABLE_MAX) {
-            HAL_DBG("match table out of range");
-            return;
-        }
-        psu_match_table[psu_match_table_size++] = &match[i];
-    }
-}
-
-static psu_object_t *psu_try_alloc(psu_alloc_t *alloc)
-{
-    psu_object_t *psu = NULL;
-    // 遍历alloc函数
-    while (*alloc) {
-        psu = (*alloc)();
-        if (psu) {
-            // 测试是否能获取到电源状态
-            if (psu_status(psu, 0) >= 0)
-                return psu;
-            psu->free(psu);
-        }
-        ++alloc;
-    }
-    return NULL;
-}
-
-static psu_match_t *psu_get_match_next(psu_match_t *match, int match_model)
-{
-    int idx = 0;
-
-    /* 1. 先找到当前index */
-    if (match) {
-        for (int i = 0; i < psu_match_table_size; ++i) {
-            psu_match_t *t = psu_match_table[i];
-            if (t == match) {
-                idx = i + 1;
-                break;
-            }
-        }
-    }
-
-    /* 2. 根据上次的idx, 找到下一个匹配 */
-    for (int i = idx; i < psu_match_table_size; ++i) {
-        psu_match_t *t = psu_match_table[i];
-
-        if (match_model) {
-            const char *model = t->product_model;
-            if (!model || !product_model_match(model))
-                continue;
-        }
-
-        if (family_match(&t->family))  
-            return t;
-    }
-
-    return NULL;
-}
-
-psu_object_t *psu_alloc(void)
-{
-    psu_object_t *psu = NULL;
-    psu_match_t *t = NULL;
-    int is_product_model = false;
-
-    // 1.先匹配带product_model
-    do {
-        t = psu_get_match_next(t, 1);
-        if (!t)
-            break;
-        is_product_model = true;
-        HAL_DBG("psu alloc by product_model");
-        psu = psu_try_alloc(t->match);
-        if (psu)
-            return psu;
-    } while(t);
-
-    // 如果已经匹配到product_model就直接返回不继续匹配
-    if (is_product_model)
-        return NULL;
-
-    // 2. 再匹配不带product_model
-    t = NULL;
-    do {
-        t = psu_get_match_next(t, 0);
-        if (!t)
-            break;
-        psu = psu_try_alloc(t->match);
-        if (psu)
-            return psu;
-    } while(t);
-
-    return NULL;
-}
-
-void psu_free(psu_object_t *psu)
-{
-    if (psu)
-        psu->free(psu);
-}
-
-int psu_status(psu_object_t *psu, uint32_t idx)
-{
-    return psu->status ? psu->status(psu, idx) : -OS_EINVAL;
-}
-
-double psu_power_input(psu_object_t *psu, uint32_t idx)
-{
-    return psu->pin ? psu->pin(psu, idx) : 0;
-}
-
-double psu_power_output(psu_object_t *psu, uint32_t idx)
-{
-    return psu->pout ? psu->pout(psu, idx) : 0;
-}
-
-hal_psu_type_e psu_type(psu_object_t *psu)
-{
-    return psu ? psu->type : HAL_PSU_UNKNOW;
-}
-
-typedef void(*register_fun_t)(void);
-
-__attribute__((constructor)) 
-static void psu_register_construct(void) 
-{
-    register_fun_t reg[] = {
-        psu_mmap_register,
-        psu_smbus_register,
-#if defined __x86_64__ || defined __i386__
-        psu_ioport_register,
-#endif
-    };
-
-    for (int i = 0; i < HAL_ARRSZ(reg); ++i)
-        reg[i]();
+#include <base/oserror.h>
+#include <stdlib.h>
+#include <errno.h>
+#include <stdio.h>
+#include <string.h>
+#include <time.h>
+#include <poll.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include "hal_utils_inner.h"
+#include "hal_hwinfo.h"
+#include "psu.h"
+#include "pmbus.h"
+
+#define family_ok(_f1, _f2)                                                \
+    ({                                                                     \
+        int _ok = 0;                                                       \
+        const char *str = hal_get_hwinfo(_f2) ?: "";                       \
+        if (_f1 == NULL || _f1[0] == '\0' || !strcmp(_f1, HAL_FAMILY_ALL)) \
+            _ok = 1;                                                       \
+        else if (!strcmp(_f1, str))                                        \
+            _ok = 1;                                                       \
+        _ok;                                                               \
+    })
+
+static bool family_match(hal_family_t *family)
+{
+    if (!family_ok(family->vendor, HAL_DATA_HW_VENDOR))
+        return false;
+    if (!family_ok(family->platform, HAL_DATA_HW_PLATFORM))
+        return false;
+    if (!family_ok(family->model, HAL_DATA_HW_MODEL))
+        return false;
+    return true;
+}
+
+static bool product_model_match(const char *model)
+{
+    const char *str = hal_get_hwinfo(HAL_DATA_HW_PRODUCT_MODEL);
+    return strcmp(str, model) == 0;
+}
+
+#define PSU_MATCH_TABLE_MAX 32
+static psu_match_t *psu_match_table[PSU_MATCH_TABLE_MAX];
+static int psu_match_table_size;
+
+void psu_register(psu_match_t *match, int size)
+{
+    for (int i = 0; i < size; i++) {
+        if (psu_match_table_size >= PSU_MATCH_TABLE_MAX) {
+            HAL_DBG("match table out of range");
+            return;
+        }
+        psu_match_table[psu_match_table_size++] = &match[i];
+    }
+}
+
+// 并行探测的共享状态，由调用者和各探测线程共同持有，最后一个退出的释放
+typedef struct psu_probe_t psu_probe_t;
+typedef struct {
+    psu_probe_t *pb;
+    int idx;
+    psu_alloc_t alloc;
+} psu_probe_arg_t;
+
+struct psu_probe_t {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int refs;
+    int decided;                                // 已经选出结果，之后完成的探测自行释放
+    psu_object_t *res[PSU_ALLOC_FUN_MAX];
+    uint8_t done[PSU_ALLOC_FUN_MAX];
+    psu_probe_arg_t arg[PSU_ALLOC_FUN_MAX];
+};
+
+static void psu_probe_put(psu_probe_t *pb)
+{
+    pthread_mutex_lock(&pb->lock);
+    int last = --pb->refs == 0;
+    pthread_mutex_unlock(&pb->lock);
+    if (!last)
+        return;
+
+    pthread_mutex_destroy(&pb->lock);
+    pthread_cond_destroy(&pb->cond);
+    free(pb);
+}
+
+static int psu_probe_decided(psu_probe_t *pb)
+{
+    pthread_mutex_lock(&pb->lock);
+    int decided = pb->decided;
+    pthread_mutex_unlock(&pb->lock);
+    return decided;
+}
+
+static void *psu_probe_thread(void *priv)
+{
+    psu_probe_arg_t *arg = priv;
+    psu_probe_t *pb = arg->pb;
+
+    // alloc 函数只创建对象不访问总线，已经有结果时跳过状态探测
+    psu_object_t *psu = arg->alloc();
+    if (psu && (psu_probe_decided(pb) || psu_status(psu, 0) < 0)) {
+        psu_free(psu);
+        psu = NULL;
+    }
+
+    pthread_mutex_lock(&pb->lock);
+    int lost = pb->decided;
+    if (!lost)
+        pb->res[arg->idx] = psu;
+    pb->done[arg->idx] = 1;
+    pthread_cond_broadcast(&pb->cond);
+    pthread_mutex_unlock(&pb->lock);
+
+    if (lost && psu)
+        psu_free(psu);
+    psu_probe_put(pb);
+    return NULL;
+}
+
+static psu_object_t *psu_try_alloc_parallel(psu_alloc_t *alloc)
+{
+    psu_probe_t *pb = calloc(1, sizeof(psu_probe_t));
+    ASSERT_FR(pb, NULL, "malloc fail!");
+    pthread_mutex_init(&pb->lock, NULL);
+    pthread_cond_init(&pb->cond, NULL);
+    pb->refs = 1;
+
+    int num = 0;
+    while (num < PSU_ALLOC_FUN_MAX && alloc[num]) {
+        psu_probe_arg_t *arg = &pb->arg[num];
+        arg->pb = pb;
+        arg->idx = num++;
+        arg->alloc = alloc[arg->idx];
+
+        pthread_mutex_lock(&pb->lock);
+        pb->refs++;
+        pthread_mutex_unlock(&pb->lock);
+
+        pthread_t tid;
+        if (pthread_create(&tid, NULL, psu_probe_thread, arg) == 0) {
+            pthread_detach(tid);
+            continue;
+        }
+        HAL_DBG("create probe thread fail, probe inline");
+        psu_probe_thread(arg);
+    }
+
+    // 排在前面的都失败后，第一个成功的胜出，不等排在后面的探测结束
+    psu_object_t *psu = NULL;
+    pthread_mutex_lock(&pb->lock);
+    for (int i = 0; i < num;) {
+        if (!pb->done[i]) {
+            pthread_cond_wait(&pb->cond, &pb->lock);
+            continue;
+        }
+        if (pb->res[i]) {
+            psu = pb->res[i];
+            pb->res[i] = NULL;
+            break;
+        }
+        i++;
+    }
+
+    // 已经完成的落选者由这里释放，未完成的看到结果后跳过探测并自行释放
+    psu_object_t *lost[PSU_ALLOC_FUN_MAX] = { 0 };
+    pb->decided = 1;
+    for (int i = 0; i < num; i++) {
+        lost[i] = pb->res[i];
+        pb->res[i] = NULL;
+    }
+    pthread_mutex_unlock(&pb->lock);
+
+    for (int i = 0; i < num; i++)
+        psu_free(lost[i]);
+    psu_probe_put(pb);
+    return psu;
+}
+
+static psu_object_t *psu_try_alloc_serial(psu_alloc_t *alloc)
+{
+    psu_object_t *psu = NULL;
+    // 遍历alloc函数
+    while (*alloc) {
+        psu = (*alloc)();
+        if (psu) {
+            // 测试是否能获取到电源状态
+            if (psu_status(psu, 0) >= 0)
+                return psu;
+            psu_free(psu);
+        }
+        ++alloc;
+    }
+    return NULL;
+}
+
+static psu_object_t *psu_try_alloc(psu_match_t *t)
+{
+    psu_object_t *psu = t->probe == PSU_PROBE_PARALLEL ? psu_try_alloc_parallel(t->match)
+                                                       : psu_try_alloc_serial(t->match);
+    // 只有胜出的候选才探测读取计划，落选者不产生额外的总线访问
+    if (psu && psu->discover && psu->discover(psu) < 0)
+        HAL_DBG("psu(%d) discover fail, use declared registers", psu->type);
+    return psu;
+}
+
+static psu_match_t *psu_get_match_next(psu_match_t *match, int match_model)
+{
+    int idx = 0;
+
+    /* 1. 先找到当前index */
+    if (match) {
+        for (int i = 0; i < psu_match_table_size; ++i) {
+            psu_match_t *t = psu_match_table[i];
+            if (t == match) {
+                idx = i + 1;
+                break;
+            }
+        }
+    }
+
+    /* 2. 根据上次的idx, 找到下一个匹配 */
+    for (int i = idx; i < psu_match_table_size; ++i) {
+        psu_match_t *t = psu_match_table[i];
+
+        if (match_model) {
+            const char *model = t->product_model;
+            if (!model || !product_model_match(model))
+                continue;
+        }
+
+        if (family_match(&t->family))  
+            return t;
+    }
+
+    return NULL;
+}
+
+psu_object_t *psu_alloc(void)
+{
+    psu_object_t *psu = NULL;
+    psu_match_t *t = NULL;
+    int is_product_model = false;
+
+    // 1.先匹配带product_model
+    do {
+        t = psu_get_match_next(t, 1);
+        if (!t)
+            break;
+        is_product_model = true;
+        HAL_DBG("psu alloc by product_model");
+        psu = psu_try_alloc(t);
+        if (psu)
+            return psu;
+    } while(t);
+
+    // 如果已经匹配到product_model就直接返回不继续匹配
+    if (is_product_model)
+        return NULL;
+
+    // 2. 再匹配不带product_model
+    t = NULL;
+    do {
+        t = psu_get_match_next(t, 0);
+        if (!t)
+            break;
+        psu = psu_try_alloc(t);
+        if (psu)
+            return psu;
+    } while(t);
+
+    return NULL;
+}
+
+psu_object_t *psu_object_alloc(uint32_t psu_num)
+{
+    ASSERT_FR(psu_num > 0 && psu_num <= PSU_NUM_MAX, NULL, "Invalid psu num %u", psu_num);
+
+    psu_object_t *psu = calloc(1, sizeof(psu_object_t) + psu_num * sizeof(psu_slot_t));
+    ASSERT_FR(psu, NULL, "malloc fail!");
+
+    psu->psu_num = psu_num;
+    psu->alert_fd = -1;
+    psu->ara_fd = -1;
+    pthread_mutex_init(&psu->alert_lock, NULL);
+    pthread_mutex_init(&psu->flight_lock, NULL);
+    pthread_cond_init(&psu->flight_cond, NULL);
+    return psu;
+}
+
+uint32_t psu_count(psu_object_t *psu)
+{
+    return psu ? psu->psu_num : 0;
+}
+
+void psu_free(psu_object_t *psu)
+{
+    if (psu) {
+        psu_alert_disable(psu);
+        pthread_mutex_destroy(&psu->alert_lock);
+        pthread_mutex_destroy(&psu->flight_lock);
+        pthread_cond_destroy(&psu->flight_cond);
+        psu->free(psu);
+    }
+}
+
+int psu_smbus_ara(psu_object_t *psu)
+{
+    ASSERT_FR(psu && psu->ara_fd >= 0, -1, "Invalid argument");
+
+    // ARA 是一次 receive byte，地址在高7位
+    uint8_t addr = 0;
+    if (read(psu->ara_fd, &addr, 1) != 1)
+        return -1;
+
+    return addr >> 1;
+}
+
+static uint64_t psu_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+void psu_deadline_set(psu_object_t *psu, uint32_t xfer_ms, uint32_t backoff_ms)
+{
+    if (!psu)
+        return;
+    psu->xfer_ms = xfer_ms;
+    psu->backoff_ms = backoff_ms;
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++)
+        __atomic_store_n(&psu->slot[idx].hold_ns, 0, __ATOMIC_RELAXED);
+}
+
+int psu_deadline_begin(psu_object_t *psu, uint32_t idx, uint64_t *start)
+{
+    *start = psu_now_ns();
+    if (!psu->xfer_ms || idx >= psu->psu_num)
+        return 0;
+    return *start < __atomic_load_n(&psu->slot[idx].hold_ns, __ATOMIC_RELAXED) ? -ETIMEDOUT : 0;
+}
+
+int psu_deadline_end(psu_object_t *psu, uint32_t idx, uint64_t start)
+{
+    if (!psu->xfer_ms || idx >= psu->psu_num)
+        return 0;
+
+    uint64_t now = psu_now_ns();
+    if (now - start <= (uint64_t)psu->xfer_ms * 1000000ull)
+        return 0;
+
+    // 卡住的设备可能让mux或从设备处于未知状态，下一次事务重新切通路
+    HAL_ERR("psu%u read took %llu ms, skip it for %u ms", idx + 1,
+            (unsigned long long)((now - start) / 1000000), psu->backoff_ms);
+    __atomic_store_n(&psu->slot[idx].hold_ns, now + (uint64_t)psu->backoff_ms * 1000000ull, __ATOMIC_RELAXED);
+    // 读取已经释放了总线，清空通路缓存需要重新持有总线锁，锁可重入，调用者持有时也可以调用
+    if (smbus_arb_lock(psu->arb) == 0) {
+        smbus_arb_mux_invalidate(psu->arb);
+        smbus_arb_unlock(psu->arb);
+    }
+    return -ETIMEDOUT;
+}
+
+// 带截止时间读状态，超时的结果按过期处理
+static int psu_read_status(psu_object_t *psu, uint32_t idx)
+{
+    uint64_t start;
+    if (psu_deadline_begin(psu, idx, &start))
+        return -ETIMEDOUT;
+    int st = psu->status(psu, idx);
+    return psu_deadline_end(psu, idx, start) ? -ETIMEDOUT : st;
+}
+
+// 记录本次读到的状态，返回是否从不在位/关闭变为在位，在 flight_lock 内判断，并发的调用只有一个看到变化
+// 拔出后不应答的电源读状态失败，按不在位记录；超时退避时电源状态未知，不记录
+static int psu_presence_edge(psu_object_t *psu, uint32_t idx, int st)
+{
+    if (st == -ETIMEDOUT)
+        return 0;
+    if (st < 0)
+        st = HAL_PSU_STAT_NA;
+
+    psu_slot_t *slot = &psu->slot[idx];
+    pthread_mutex_lock(&psu->flight_lock);
+    int edge = slot->prev_valid && slot->prev_stat != HAL_PSU_STAT_ON && st == HAL_PSU_STAT_ON;
+    slot->prev_stat = st;
+    slot->prev_valid = 1;
+    pthread_mutex_unlock(&psu->flight_lock);
+    return edge;
+}
+
+// 电源插入时只对这一个电源重新识别，其它电源和设备句柄不受影响
+static void psu_presence_redetect(psu_object_t *psu, uint32_t idx)
+{
+    if (!psu->redetect)
+        return;
+    HAL_DBG("psu%u inserted, redetect", idx + 1);
+    psu->redetect(psu, idx);
+}
+
+// 调用时需持有 alert_lock
+static int psu_alert_handle(psu_object_t *psu)
+{
+    int mask = 0;
+    uint8_t buf[64];
+
+    // 1. 清空告警线上的事件，gpio事件和eventfd都可以这样读空
+    while (read(psu->alert_fd, buf, sizeof(buf)) > 0)
+        ;
+
+    // 2. 通过ARA依次找出发出告警的电源，多个电源同时告警时地址小的先应答
+    for (uint32_t n = 0; psu->ara && psu->ara_fd >= 0 && n <= psu->psu_num; n++) {
+        int slave = psu->ara(psu);
+        if (slave < 0)
+            break;
+        for (uint32_t idx = 0; idx < psu->psu_num; idx++) {
+            if (psu->slot[idx].reg.slave == slave)
+                mask |= HAL_BIT(idx);
+        }
+    }
+
+    // ARA没有找到电源时无法确认告警来源，全部重新读取
+    if (!mask)
+        mask = HAL_BIT(psu->psu_num) - 1;
+
+    // 3. 只重新读告警电源的状态
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++) {
+        if (!(mask & HAL_BIT(idx)))
+            continue;
+        psu_slot_t *slot = &psu->slot[idx];
+        slot->stat_cache = psu_read_status(psu, idx);
+        slot->stat_valid = slot->stat_cache >= 0;
+        // 拔出和插入可能都发生在两次 psu_status 之间，每次刷新都要记录在位变化
+        if (psu_presence_edge(psu, idx, slot->stat_cache))
+            psu_presence_redetect(psu, idx);
+    }
+
+    return mask;
+}
+
+// 调用时需持有 alert_lock
+static void psu_alert_stop(psu_object_t *psu)
+{
+    if (!psu->alert_on)
+        return;
+    __atomic_store_n(&psu->alert_on, 0, __ATOMIC_RELEASE);
+    if (psu->ara_fd >= 0)
+        close(psu->ara_fd);
+    psu->ara_fd = -1;
+}
+
+int psu_alert_enable(psu_object_t *psu, int alert_fd, const char *i2c_dev)
+{
+    ASSERT_FR(psu && psu->status && alert_fd >= 0, -OS_EINVAL, "Invalid argument");
+
+    int flags = fcntl(alert_fd, F_GETFL);
+    ASSERT_FR(flags >= 0, -errno, "get alert fd flags fail!");
+    ASSERT_FR(fcntl(alert_fd, F_SETFL, flags | O_NONBLOCK) == 0, -errno, "set alert fd nonblock fail!");
+
+    int ara_fd = -1;
+    if (i2c_dev) {
+        ara_fd = open(i2c_dev, O_RDWR);
+        ASSERT_FR(ara_fd >= 0, -errno, "open %s fail!", i2c_dev);
+        if (ioctl(ara_fd, I2C_SLAVE_FORCE, SMBUS_ARA_ADDR) < 0) {
+            close(ara_fd);
+            ara_fd = -1;
+        }
+    }
+    // 只在这里检查一次，之后的告警不再尝试ARA
+    if (ara_fd < 0 && psu->ara)
+        HAL_DBG("ARA not available, alert will refresh all psu");
+
+    pthread_mutex_lock(&psu->alert_lock);
+    psu_alert_stop(psu);
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++)
+        psu->slot[idx].stat_valid = 0;
+    psu->ara_fd = ara_fd;
+    psu->alert_fd = alert_fd;
+    __atomic_store_n(&psu->alert_on, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&psu->alert_lock);
+    return 0;
+}
+
+void psu_alert_disable(psu_object_t *psu)
+{
+    if (!psu)
+        return;
+
+    // alert_lock 保留到 psu_free，正在处理告警的调用结束后才关闭
+    pthread_mutex_lock(&psu->alert_lock);
+    psu_alert_stop(psu);
+    pthread_mutex_unlock(&psu->alert_lock);
+}
+
+int psu_alert_wait(psu_object_t *psu, int timeout_ms)
+{
+    ASSERT_FR(psu && __atomic_load_n(&psu->alert_on, __ATOMIC_ACQUIRE), -OS_EINVAL, "Invalid argument");
+
+    struct pollfd pfd = { .fd = psu->alert_fd, .events = POLLIN };
+    int ret = poll(&pfd, 1, timeout_ms);
+    if (ret < 0)
+        return -errno;
+    if (ret == 0)
+        return 0;
+
+    // 等待期间告警模式可能已被关闭
+    pthread_mutex_lock(&psu->alert_lock);
+    ret = psu->alert_on ? psu_alert_handle(psu) : -OS_EINVAL;
+    pthread_mutex_unlock(&psu->alert_lock);
+    return ret;
+}
+
+// 同一电源的同一读操作正在进行时等待它完成，返回1并通过 val 带回结果；否则占住该操作返回0
+static int psu_flight_begin(psu_object_t *psu, uint32_t idx, int op, double *val)
+{
+    psu_flight_t *f = &psu->slot[idx].flight[op];
+    int shared = 0;
+
+    pthread_mutex_lock(&psu->flight_lock);
+    if (f->busy) {
+        uint32_t gen = f->gen;
+        while (f->gen == gen)
+            pthread_cond_wait(&psu->flight_cond, &psu->flight_lock);
+        *val = f->val;
+        shared = 1;
+    } else {
+        f->busy = 1;
+    }
+    pthread_mutex_unlock(&psu->flight_lock);
+    return shared;
+}
+
+static void psu_flight_end(psu_object_t *psu, uint32_t idx, int op, double val)
+{
+    psu_flight_t *f = &psu->slot[idx].flight[op];
+
+    pthread_mutex_lock(&psu->flight_lock);
+    f->val = val;
+    f->busy = 0;
+    f->gen++;
+    pthread_cond_broadcast(&psu->flight_cond);
+    pthread_mutex_unlock(&psu->flight_lock);
+}
+
+// 合并并发的功率读取，N 个同时到达的调用只访问一次总线
+static double psu_flight_power(psu_object_t *psu, uint32_t idx, int op,
+                               double (*read)(psu_object_t *psu, uint32_t idx))
+{
+    if (idx >= psu->psu_num)
+        return read(psu, idx);
+
+    double val;
+    if (psu_flight_begin(psu, idx, op, &val))
+        return val;
+    uint64_t start;
+    if (psu_deadline_begin(psu, idx, &start)) {
+        val = -ETIMEDOUT;
+    } else {
+        val = read(psu, idx);
+        if (psu_deadline_end(psu, idx, start))
+            val = -ETIMEDOUT;
+    }
+    psu_flight_end(psu, idx, op, val);
+    return val;
+}
+
+int psu_status(psu_object_t *psu, uint32_t idx)
+{
+    if (!psu->status)
+        return -OS_EINVAL;
+    if (idx >= psu->psu_num)
+        return psu->status(psu, idx);
+
+    if (__atomic_load_n(&psu->alert_on, __ATOMIC_ACQUIRE)) {
+        pthread_mutex_lock(&psu->alert_lock);
+        // 加锁前告警模式可能已被关闭，此时按普通方式读取
+        if (psu->alert_on) {
+            // 处理已经到达但还没人等待的告警
+            struct pollfd pfd = { .fd = psu->alert_fd, .events = POLLIN };
+            if (poll(&pfd, 1, 0) > 0)
+                psu_alert_handle(psu);
+
+            // 两次告警之间直接返回上次的状态
+            psu_slot_t *slot = &psu->slot[idx];
+            if (!slot->stat_valid) {
+                slot->stat_cache = psu_read_status(psu, idx);
+                slot->stat_valid = slot->stat_cache >= 0;
+            }
+            int st = slot->stat_cache;
+            int edge = psu_presence_edge(psu, idx, st);
+
+            pthread_mutex_unlock(&psu->alert_lock);
+            if (edge)
+                psu_presence_redetect(psu, idx);
+            return st;
+        }
+        pthread_mutex_unlock(&psu->alert_lock);
+    }
+
+    // 告警模式下 alert_lock 已经让并发调用共用缓存，不需要再合并
+    double val;
+    if (psu_flight_begin(psu, idx, PSU_FLIGHT_STATUS, &val))
+        return (int)val;
+    int st = psu_read_status(psu, idx);
+    if (psu_presence_edge(psu, idx, st))
+        psu_presence_redetect(psu, idx);
+    psu_flight_end(psu, idx, PSU_FLIGHT_STATUS, st);
+    return st;
+}
+
+double psu_power_input(psu_object_t *psu, uint32_t idx)
+{
+    return psu->pin ? psu_flight_power(psu, idx, PSU_FLIGHT_PIN, psu->pin) : 0;
+}
+
+double psu_power_output(psu_object_t *psu, uint32_t idx)
+{
+    return psu->pout ? psu_flight_power(psu, idx, PSU_FLIGHT_POUT, psu->pout) : 0;
+}
+
+#define PMBUS_ENERGY_ACC_WRAP     (0x8000u << 8)    // 累加器15位 + 翻转计数8位
+#define PMBUS_ENERGY_SAMPLE_WRAP  (1u << 24)
+
+void psu_pec_enable(psu_object_t *psu, int on)
+{
+    if (psu)
+        psu->pec = !!on;
+}
+
+int psu_read_word(psu_object_t *psu, uint8_t slave, uint8_t cmd, uint16_t *val)
+{
+    ASSERT_FR(psu && psu->smb && val, -OS_EINVAL, "Invalid argument");
+    hal_smbus_t *smb = psu->smb;
+
+    // 状态类命令优先于功率等读取
+    int prio = PMBUS_IS_STATUS(cmd) ? SMBUS_PRIO_URGENT : SMBUS_PRIO_NORMAL;
+    int ret = smbus_sched_acquire(psu->sched, prio, 0);
+    ASSERT_FR(ret == 0, ret, "psu bus busy!");
+
+    if (psu->pec)
+        ret = pmbus_read_word_pec(smb, slave, cmd, val);
+    else
+        ret = smb->read_word(smb, slave, cmd, val);
+
+    smbus_sched_release(psu->sched);
+    return ret;
+}
+
+void psu_plan_declare(psu_object_t *psu, uint32_t idx, int metric, int cap, uint8_t cmd)
+{
+    if (!psu || idx >= psu->psu_num || metric < 0 || metric >= PSU_METRIC_NUM) {
+        HAL_ERR("Invalid argument");
+        return;
+    }
+
+    psu_plan_t *plan = &psu->slot[idx].plan[metric];
+    plan->cmd = cmd;
+    plan->cap = cap;
+    plan->declared = cap;
+    plan->fmt = PMBUS_FMT_LINEAR;
+}
+
+// 调用时已经获得总线，QUERY 失败说明设备不支持 QUERY，保留后端声明
+static void psu_plan_probe(psu_object_t *psu, int fd, uint8_t slave, psu_plan_t *plan, int metric)
+{
+    uint8_t q = 0;
+    if (pmbus_query(fd, slave, plan->cmd, psu->pec, &q) != 0) {
+        if (plan->cap == PSU_CAP_PROBE)
+            plan->cap = PSU_CAP_NO;
+        return;
+    }
+
+    if (!(q & PMBUS_QUERY_SUPPORTED) || !(q & PMBUS_QUERY_READ)) {
+        plan->cap = PSU_CAP_NO;
+        return;
+    }
+
+    // 电能累加器固定是直接格式，QUERY 的格式位对块读命令没有意义
+    int energy = metric == PSU_METRIC_EIN || metric == PSU_METRIC_EOUT;
+    plan->fmt = energy ? PMBUS_FMT_DIRECT : PMBUS_QUERY_FMT(q);
+    plan->cap = PSU_CAP_YES;
+    if (plan->fmt != PMBUS_FMT_DIRECT)
+        return;
+
+    // 直接格式必须拿到系数才能解码，电能读不到系数时按 m=1 处理
+    if (pmbus_coefficients(fd, slave, plan->cmd, psu->pec, &plan->coef) == 0)
+        return;
+    if (energy) {
+        plan->coef = (pmbus_coef_t){ .m = 1 };
+        return;
+    }
+    HAL_DBG("psu 0x%x cmd 0x%x direct format without coefficients", slave, plan->cmd);
+    plan->cap = PSU_CAP_NO;
+}
+
+// 探测单个电源，调用时不持有总线
+static int psu_pmbus_discover_slot(psu_object_t *psu, int fd, uint32_t idx)
+{
+    psu_slot_t *slot = &psu->slot[idx];
+    uint8_t slave = slot->reg.slave;
+
+    // 整个探测过程占用总线，避免和周期读取交错
+    if (smbus_sched_acquire(psu->sched, SMBUS_PRIO_NORMAL, 0) != 0) {
+        HAL_DBG("psu%u discover skipped, bus busy", idx + 1);
+        return 0;
+    }
+
+    // 读不到 REVISION 说明不是标准PMBus设备，只保留后端声明的指标
+    uint8_t rev = 0;
+    int pmbus = psu->smb->read_r(psu->smb, slave, PMBUS_REVISION, &rev, 1) == 1;
+    slot->revision = pmbus ? rev : 0;
+
+    for (int m = 0; m < PSU_METRIC_NUM; m++) {
+        psu_plan_t *plan = &slot->plan[m];
+        if (plan->cap != PSU_CAP_ASSUMED && plan->cap != PSU_CAP_PROBE)
+            continue;
+        if (pmbus)
+            psu_plan_probe(psu, fd, slave, plan, m);
+        else if (plan->cap == PSU_CAP_PROBE)
+            plan->cap = PSU_CAP_NO;
+    }
+    smbus_sched_release(psu->sched);
+
+    // 两个方向都没有累加器时不再尝试硬件读取
+    if (slot->plan[PSU_METRIC_EIN].cap == PSU_CAP_NO && slot->plan[PSU_METRIC_EOUT].cap == PSU_CAP_NO) {
+        pthread_mutex_lock(&psu->flight_lock);
+        slot->energy_mode = PSU_ENERGY_SOFT;
+        pthread_mutex_unlock(&psu->flight_lock);
+    }
+
+    HAL_DBG("psu%u 0x%x revision 0x%x pin %d pout %d ein %d eout %d", idx + 1, slave, slot->revision,
+            slot->plan[PSU_METRIC_PIN].cap, slot->plan[PSU_METRIC_POUT].cap,
+            slot->plan[PSU_METRIC_EIN].cap, slot->plan[PSU_METRIC_EOUT].cap);
+    return pmbus;
+}
+
+int psu_pmbus_discover(psu_object_t *psu, const char *i2c_dev)
+{
+    ASSERT_FR(psu && psu->smb && i2c_dev, -OS_EINVAL, "Invalid argument");
+
+    int fd = open(i2c_dev, O_RDWR);
+    ASSERT_FR(fd >= 0, -errno, "open %s fail!", i2c_dev);
+
+    int found = 0;
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++)
+        found += psu_pmbus_discover_slot(psu, fd, idx);
+
+    close(fd);
+    return found;
+}
+
+int psu_pmbus_rediscover(psu_object_t *psu, uint32_t idx, const char *i2c_dev)
+{
+    ASSERT_FR(psu && psu->smb && i2c_dev && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+
+    // 换上的可能是另一个型号，回到后端声明的状态重新探测
+    psu_slot_t *slot = &psu->slot[idx];
+    pthread_mutex_lock(&psu->flight_lock);
+    for (int m = 0; m < PSU_METRIC_NUM; m++) {
+        psu_plan_t *plan = &slot->plan[m];
+        plan->cap = plan->declared;
+        plan->fmt = PMBUS_FMT_LINEAR;
+        memset(&plan->coef, 0, sizeof(plan->coef));
+    }
+    slot->revision = 0;
+    slot->energy_mode = PSU_ENERGY_UNKNOWN;
+    pthread_mutex_unlock(&psu->flight_lock);
+
+    int fd = open(i2c_dev, O_RDWR);
+    ASSERT_FR(fd >= 0, -errno, "open %s fail!", i2c_dev);
+    int ret = psu_pmbus_discover_slot(psu, fd, idx);
+    close(fd);
+    return ret;
+}
+
+int psu_pmbus_read(psu_object_t *psu, uint32_t idx, int metric, double *val)
+{
+    ASSERT_FR(psu && val && idx < psu->psu_num && metric >= 0 && metric < PSU_METRIC_NUM,
+              -OS_EINVAL, "Invalid argument");
+
+    const psu_plan_t *plan = &psu->slot[idx].plan[metric];
+    if (plan->cap != PSU_CAP_ASSUMED && plan->cap != PSU_CAP_YES)
+        return -ENOTSUP;
+
+    uint16_t raw = 0;
+    int ret = psu_read_word(psu, psu->slot[idx].reg.slave, plan->cmd, &raw);
+    ASSERT_FR(!ret, -1, "Smbus read power(%d) cmd 0x%x fail!", psu->type, plan->cmd);
+
+    ret = pmbus_decode(plan->fmt, &plan->coef, raw, val);
+    ASSERT_FR(!ret, -1, "psu cmd 0x%x format %d not decodable!", plan->cmd, plan->fmt);
+    return 0;
+}
+
+int psu_pmbus_energy(psu_object_t *psu, uint8_t slave, uint8_t cmd, psu_energy_t *e)
+{
+    ASSERT_FR(psu && psu->smb && e, -OS_EINVAL, "Invalid argument");
+
+    uint8_t buf[PMBUS_ENERGY_LEN] = { 0 };
+    hal_smbus_t *smb = psu->smb;
+    int ret = smbus_sched_acquire(psu->sched, SMBUS_PRIO_NORMAL, 0);
+    ASSERT_FR(ret == 0, ret, "psu bus busy!");
+    ret = psu->pec ? pmbus_read_block_pec(smb, slave, cmd, buf, PMBUS_ENERGY_LEN)
+                   : smb->rblock(smb, slave, cmd, buf, PMBUS_ENERGY_LEN);
+    smbus_sched_release(psu->sched);
+    ASSERT_FR(ret == PMBUS_ENERGY_LEN, -1, "Smbus read power(0x%x) energy fail!", slave);
+
+    memset(e, 0, sizeof(*e));
+    e->mode = PSU_ENERGY_HW;
+    e->m = 1;
+    e->acc = (uint32_t)buf[2] * 0x8000u + ((buf[0] | buf[1] << 8) & 0x7fff);
+    e->samples = buf[3] | buf[4] << 8 | (uint32_t)buf[5] << 16;
+    e->ts_ns = psu_now_ns();
+    return 0;
+}
+
+static void psu_energy_soft(psu_energy_sw_t *sw, double watts, psu_energy_t *e)
+{
+    uint64_t now = psu_now_ns();
+
+    // 梯形积分，第一次读数只记录起点
+    if (sw->ts_ns)
+        sw->joules += (sw->watts + watts) / 2 * (now - sw->ts_ns) / 1e9;
+    sw->ts_ns = now;
+    sw->watts = watts;
+
+    memset(e, 0, sizeof(*e));
+    e->mode = PSU_ENERGY_SOFT;
+    e->joules = sw->joules;
+    e->ts_ns = now;
+}
+
+static int psu_energy(psu_object_t *psu, uint32_t idx, int out, psu_energy_t *e)
+{
+    ASSERT_FR(psu && e && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    psu_slot_t *slot = &psu->slot[idx];
+
+    // 读总线时不持锁，flight_lock 只保护 energy_mode 和软件积分状态
+    pthread_mutex_lock(&psu->flight_lock);
+    const psu_plan_t *plan = &slot->plan[out ? PSU_METRIC_EOUT : PSU_METRIC_EIN];
+    uint8_t cap = plan->cap;
+    uint8_t mode = slot->energy_mode;
+    pmbus_coef_t coef = plan->coef;
+    pthread_mutex_unlock(&psu->flight_lock);
+
+    // 只有声明或确认支持累加器时才读取，PSU_CAP_NONE/PROBE/NO 都走软件积分
+    if (psu->energy && mode != PSU_ENERGY_SOFT && (cap == PSU_CAP_YES || cap == PSU_CAP_ASSUMED)) {
+        int ret = psu->energy(psu, idx, out, e);
+        pthread_mutex_lock(&psu->flight_lock);
+        if (ret == 0)
+            slot->energy_mode = PSU_ENERGY_HW;
+        else if (slot->energy_mode == PSU_ENERGY_UNKNOWN)
+            // 第一次就读不到累加器，认为电源不支持，以后都走软件积分
+            slot->energy_mode = PSU_ENERGY_SOFT;
+        mode = slot->energy_mode;
+        pthread_mutex_unlock(&psu->flight_lock);
+
+        if (ret == 0) {
+            // 探测到了系数时按设备上报的直接格式换算
+            if (cap == PSU_CAP_YES && coef.m) {
+                e->m = coef.m;
+                e->b = coef.b;
+                e->R = coef.R;
+            }
+            return 0;
+        }
+        if (mode != PSU_ENERGY_SOFT)
+            return -1;
+    }
+
+    double watts = out ? psu_power_output(psu, idx) : psu_power_input(psu, idx);
+    ASSERT_FR(watts >= 0, -1, "read power(%d) watts fail!", psu->type);
+
+    pthread_mutex_lock(&psu->flight_lock);
+    psu_energy_soft(&slot->energy_sw[out], watts, e);
+    pthread_mutex_unlock(&psu->flight_lock);
+    return 0;
+}
+
+int psu_energy_input(psu_object_t *psu, uint32_t idx, psu_energy_t *e)
+{
+    return psu_energy(psu, idx, 0, e);
+}
+
+int psu_energy_output(psu_object_t *psu, uint32_t idx, psu_energy_t *e)
+{
+    return psu_energy(psu, idx, 1, e);
+}
+
+double psu_energy_avg_watts(const psu_energy_t *start, const psu_energy_t *end)
+{
+    ASSERT_FR(start && end && start->mode == end->mode, 0, "Invalid argument");
+
+    if (end->mode == PSU_ENERGY_SOFT) {
+        if (end->ts_ns <= start->ts_ns)
+            return 0;
+        return (end->joules - start->joules) * 1e9 / (end->ts_ns - start->ts_ns);
+    }
+
+    // 累加器和采样计数都会回绕，按模运算取差值
+    uint32_t acc = (end->acc - start->acc) % PMBUS_ENERGY_ACC_WRAP;
+    uint32_t samples = (end->samples - start->samples) % PMBUS_ENERGY_SAMPLE_WRAP;
+    if (!samples || !end->m)
+        return 0;
+
+    // 先求直接格式下的平均值，再换算成实际功率
+    double y = (double)acc / samples;
+    for (int r = end->R; r > 0; r--)
+        y /= 10;
+    for (int r = end->R; r < 0; r++)
+        y *= 10;
+    return (y - end->b) / end->m;
+}
+
+double psu_energy_kwh(const psu_energy_t *start, const psu_energy_t *end)
+{
+    ASSERT_FR(start && end && end->ts_ns > start->ts_ns, 0, "Invalid argument");
+
+    double seconds = (end->ts_ns - start->ts_ns) / 1e9;
+    return psu_energy_avg_watts(start, end) * seconds / 3600000.0;
+}
+
+hal_psu_type_e psu_type(psu_object_t *psu)
+{
+    return psu ? psu->type : HAL_PSU_UNKNOW;
+}
+
+typedef void(*register_fun_t)(void);
+
+__attribute__((constructor)) 
+static void psu_register_construct(void) 
+{
+    // 先注册内核hwmon后端，驱动已经接管电源时不再直接访问总线
+    register_fun_t reg[] = {
+        psu_hwmon_register,
+        psu_mmap_register,
+        psu_smbus_register,
+#if defined __x86_64__ || defined __i386__
+        psu_ioport_register,
+#endif
+    };
+
+    for (int i = 0; i < HAL_ARRSZ(reg); ++i)
+        reg[i]();
 }
\ No newline at end of file
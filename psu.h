@@ -1,150 +1,381 @@
-#ifndef __SXF_PSU_H__
-#define __SXF_PSU_H__
-
-#include "hal_utils.h"
-#include "hal_sensor.h"
-
-#define PSU_NUM 2        // 支持电源个数
-#define PSU_SET_STAT(_buf, _id, _stat)   \
-    do {                                 \
-        uint8_t *__buf = _buf;           \
-        uint8_t __stat = _stat;          \
-        int __idx = psu_stat_index(_id); \
-        if (__idx >= 0)                  \
-            __buf[__idx] = __stat;       \
-    } while (0)
-#define PSU_GET_STAT(_buf, _id) ({   \
-    uint8_t *__buf = _buf;           \
-    int __idx = psu_stat_index(_id); \
-    (__idx >= 0) ? __buf[__idx] : 0; \
-})
-
-static inline int psu_stat_index(int id)
-{
-    switch (id) {
-    case HAL_SEN_PSU_PIN1:
-    case HAL_SEN_PSU_POUT1:
-    case HAL_SEN_PSU_STATUS1:
-        return 0;
-
-    case HAL_SEN_PSU_PIN2:
-    case HAL_SEN_PSU_POUT2:
-    case HAL_SEN_PSU_STATUS2:
-        return 1;
-
-    default:
-        return -1;
-    }
-}
-
-static inline double psu_lineal_value(uint32_t value)
-{
-    int ly = value & 0x7FF;         // lineal_y
-    int ln = value & 0xF800;        // lineal_n
-
-    if (value & 0x400)
-        ly -= 1 << 11;
-
-    if (value & 0x8000)
-        ln = (ln >> 11) - (1 << 5);
-
-    double result = ly;
-    int abs = ln > 0 ? ln : -ln;
-
-    while (abs--)
-        result *= (ln >= 0) ? 2.0 : 0.5;
-
-    return result;
-}
-
-typedef enum {
-    HAL_PSU_TAIDA,          // 台达
-    HAL_PSU_OULUTONG,       // 欧陆通
-    HAL_PSU_QUANHAN,        // 全汉
-    HAL_PSU_UNKNOW,
-} hal_psu_type_e;
-
-typedef struct psu_reg_t {
-    uint8_t slave;
-    uint8_t addr;
-} psu_reg_t;
-
-typedef struct psu_object_t {
-    hal_psu_type_e type;        // 电源类型
-    void (*free)(struct psu_object_t *psu);
-    int (*status)(struct psu_object_t *psu, uint32_t idx);         // 电源状态
-    double (*pin)(struct psu_object_t *psu, uint32_t idx);         // 输入功率
-    double (*pout)(struct psu_object_t *psu, uint32_t idx);        // 输出功率
-    union {
-        struct {
-            hal_smbus_t *smb;
-            psu_reg_t reg[PSU_NUM];
-        };
-        // kuka 电源的私有变量
-        struct {
-            int fd;
-            void *map_base;
-            uint64_t start_addr;
-        };
-    };
-
-} psu_object_t;
-
-#define PSU_ALLOC_FUN_MAX    5        // 最多有几个alloc函数
-typedef psu_object_t *(*psu_alloc_t)();
-typedef struct {
-    hal_family_t family;
-    const char *product_model;
-    psu_alloc_t match[PSU_ALLOC_FUN_MAX];
-} psu_match_t;
-
-/**
- * @description: 申请 psu_object_t 对象
- * @return {psu_object_t*} psu句柄
- */
-psu_object_t *psu_alloc(void);
-/**
- * @description: 释放句柄
- * @param {psu_object_t*} psu : psu的句柄
- */
-void psu_free(psu_object_t *psu);
-/**
- * @description: 获取电源状态
- * @param {psu_object_t*} psu : psu的句柄
- * @param {uint32_t} idx: 第几个电源，从0开始
- * @return {double} 成功: HAL_PSU_STAT_ON/HAL_PSU_STAT_OFF/HAL_PSU_STAT_NA, 失败: -errno
- */
-int psu_status(psu_object_t *psu, uint32_t idx);
-/**
- * @description: 获取输入功率
- * @param {psu_object_t*} psu : psu的句柄
- * @param {uint32_t} idx: 第几个电源，从0开始
- * @return {double} 输入功率
- */
-double psu_power_input(psu_object_t *psu, uint32_t idx);
-/**
- * @description: 获取输出功率
- * @param {psu_object_t*} psu : psu的句柄
- * @param {uint32_t} idx: 第几个电源，从0开始
- * @return {double} 输出功率
- */
-double psu_power_output(psu_object_t *psu, uint32_t idx);
-/**
- * @description: 获取电源类型
- * @param {psu_object_t*} psu : psu的句柄
- * @return {double} 电源类型，例如台达，欧陆通，全汉等
- */
-hal_psu_type_e psu_type(psu_object_t *psu);
-/**
- * @description: 注册电源匹配规则
- * @param {psu_match_t**} match: 匹配规则
- * @param {size} size: 规则长度
- */
-void psu_register(psu_match_t *match, int size);
-void psu_mmap_register(void);
-void psu_smbus_register(void);
-#if defined __x86_64__ || defined __i386__
-void psu_ioport_register(void);
-#endif
-
+#ifndef __SXF_PSU_H__
+#define __SXF_PSU_H__
+
+#include <pthread.h>
+#include "smbus_sched.h"
+#include "smbus_arb.h"
+#include "pmbus.h"
+#include "hal_utils.h"
+#include "hal_sensor.h"
+
+#define PSU_NUM 2        // 默认支持电源个数
+#define PSU_NUM_MAX 8    // 单个对象最多支持的电源个数
+
+static inline double psu_lineal_value(uint32_t value)
+{
+    return pmbus_linear11(value);
+}
+
+#define PMBUS_READ_EIN      0x86        // 输入电能累加器
+#define PMBUS_READ_EOUT     0x87        // 输出电能累加器
+#define PMBUS_ENERGY_LEN    6           // 累加器(2) + 翻转计数(1) + 采样计数(3)
+#define SMBUS_ARA_ADDR      0x0c        // SMBus Alert Response Address
+
+typedef enum {
+    PSU_ENERGY_UNKNOWN,     // 还没读过
+    PSU_ENERGY_HW,          // 电源支持 READ_EIN/READ_EOUT
+    PSU_ENERGY_SOFT,        // 不支持，用瞬时功率做软件积分
+} psu_energy_mode_e;
+
+// 一次电能读数，两次读数之差即为区间内的电能
+typedef struct {
+    uint8_t mode;           // psu_energy_mode_e
+    int8_t R;               // 直接格式系数: X = (Y * 10^-R - b) / m
+    int16_t m;
+    int16_t b;
+    uint32_t acc;           // 硬件累加值(已计入翻转计数)
+    uint32_t samples;       // 硬件采样计数
+    double joules;          // 软件积分的电能，单位焦耳
+    uint64_t ts_ns;         // 读取时刻，CLOCK_MONOTONIC
+} psu_energy_t;
+
+// 软件积分状态
+typedef struct {
+    uint64_t ts_ns;
+    double watts;
+    double joules;
+} psu_energy_sw_t;
+
+typedef enum {
+    HAL_PSU_TAIDA,          // 台达
+    HAL_PSU_OULUTONG,       // 欧陆通
+    HAL_PSU_QUANHAN,        // 全汉
+    HAL_PSU_UNKNOW,
+} hal_psu_type_e;
+
+typedef struct psu_reg_t {
+    uint8_t slave;
+    uint8_t addr;
+} psu_reg_t;
+
+// 按读取计划访问的指标
+typedef enum {
+    PSU_METRIC_PIN,
+    PSU_METRIC_POUT,
+    PSU_METRIC_EIN,
+    PSU_METRIC_EOUT,
+    PSU_METRIC_NUM,
+} psu_metric_e;
+
+// 指标的支持情况
+typedef enum {
+    PSU_CAP_NONE,           // 后端没有声明，从不读取
+    PSU_CAP_PROBE,          // 探测确认支持后才读取
+    PSU_CAP_ASSUMED,        // 后端声明支持，设备不支持 QUERY 时按声明读取
+    PSU_CAP_YES,            // QUERY 确认支持
+    PSU_CAP_NO,             // QUERY 确认不支持，从不读取
+} psu_cap_e;
+
+// 单个指标的读取方式
+typedef struct {
+    uint8_t cmd;
+    uint8_t cap;            // psu_cap_e
+    uint8_t declared;       // 后端声明的 psu_cap_e，重新探测时从这里开始
+    uint8_t fmt;            // pmbus_fmt_e
+    pmbus_coef_t coef;      // 直接格式的系数
+} psu_plan_t;
+
+// 可以合并的读操作
+typedef enum {
+    PSU_FLIGHT_STATUS,
+    PSU_FLIGHT_PIN,
+    PSU_FLIGHT_POUT,
+    PSU_FLIGHT_NUM,
+} psu_flight_e;
+
+// 正在进行的读操作，期间到达的相同调用等待它完成并共用结果
+typedef struct {
+    uint8_t busy;
+    uint32_t gen;           // 每完成一次加1
+    double val;             // 最近一次完成的结果
+} psu_flight_t;
+
+// 单个电源的状态，按电源顺序连续存放
+typedef struct psu_slot_t {
+    psu_reg_t reg;
+    uint8_t stat_valid;
+    uint8_t energy_mode;                        // psu_energy_mode_e
+    int stat_cache;                             // 告警模式下最近一次读到的状态
+    uint8_t prev_valid;
+    int prev_stat;                              // 上一次上报的状态，用于判断插入
+    uint64_t hold_ns;                           // 读取超过截止时间后，在此之前不再访问该电源
+    psu_energy_sw_t energy_sw[2];               // 软件积分状态，[输入, 输出]
+    uint8_t revision;                           // PMBUS_REVISION，0表示没有读到
+    psu_plan_t plan[PSU_METRIC_NUM];            // 读取计划，打开时探测一次
+    psu_flight_t flight[PSU_FLIGHT_NUM];        // 按 psu_flight_e 合并并发的相同读取
+} psu_slot_t;
+
+typedef struct psu_object_t {
+    hal_psu_type_e type;        // 电源类型
+    void (*free)(struct psu_object_t *psu);
+    int (*status)(struct psu_object_t *psu, uint32_t idx);         // 电源状态
+    double (*pin)(struct psu_object_t *psu, uint32_t idx);         // 输入功率
+    double (*pout)(struct psu_object_t *psu, uint32_t idx);        // 输出功率
+    // 读取电能累加器，out: 0 输入, 1 输出; 不支持时返回失败，由上层做软件积分
+    int (*energy)(struct psu_object_t *psu, uint32_t idx, int out, psu_energy_t *e);
+    // SMBALERT# 告警模式，开启后只有告警到来时才重新读状态
+    int (*ara)(struct psu_object_t *psu);       // 读告警响应地址，返回发出告警的设备地址
+    // 电源插入(状态变为在位)后重新识别型号、读取计划等，只处理这一个电源，可以为NULL
+    int (*redetect)(struct psu_object_t *psu, uint32_t idx);
+    // 候选胜出后由 psu_alloc 调用一次，探测读取计划，可以为NULL
+    int (*discover)(struct psu_object_t *psu);
+    uint8_t alert_on;
+    int alert_fd;                               // 告警线，gpio事件fd或eventfd
+    int ara_fd;                                 // 读ARA用的i2c设备
+    pthread_mutex_t alert_lock;                 // 保护告警状态和缓存，随对象创建和释放
+    uint8_t pec;                                // PMBus读取是否校验PEC
+    uint32_t xfer_ms;                           // 单个电源一次读取的截止时间，0表示不限制
+    uint32_t backoff_ms;                        // 超时后跳过该电源的时间
+    void *priv;                                 // 后端私有数据
+    smbus_sched_t *sched;                       // 总线请求队列，NULL表示不排队
+    smbus_arb_t *arb;                           // 跨进程总线仲裁，NULL表示不加锁
+    pthread_mutex_t flight_lock;                // 保护 slot[].flight、energy_mode 和 energy_sw
+    pthread_cond_t flight_cond;                 // 读操作完成时广播
+    union {
+        struct {
+            hal_smbus_t *smb;
+        };
+        // kuka 电源的私有变量
+        struct {
+            int fd;
+            void *map_base;
+            uint64_t start_addr;
+        };
+    };
+    uint32_t psu_num;                           // 电源个数
+    psu_slot_t slot[];                          // 每个电源的状态
+} psu_object_t;
+
+#define PSU_ALLOC_FUN_MAX    5        // 最多有几个alloc函数
+typedef psu_object_t *(*psu_alloc_t)();
+
+// alloc函数的探测方式
+typedef enum {
+    PSU_PROBE_SERIAL,       // 按顺序逐个探测
+    // 同时探测，排在前面的都失败后第一个成功的胜出，不等落选者结束，落选者自行释放
+    // 同一总线上的候选会被总线队列和内核适配器锁串行化，只用于候选在不同适配器上的情况
+    PSU_PROBE_PARALLEL,
+} psu_probe_e;
+
+typedef struct {
+    hal_family_t family;
+    const char *product_model;
+    psu_alloc_t match[PSU_ALLOC_FUN_MAX];
+    uint8_t probe;                      // psu_probe_e
+} psu_match_t;
+
+/**
+ * @description: 申请 psu_object_t 对象
+ * @return {psu_object_t*} psu句柄
+ */
+psu_object_t *psu_alloc(void);
+/**
+ * @description: 申请一个空的 psu_object_t，供各电源后端使用
+ * @param {uint32_t} psu_num: 电源个数，不超过 PSU_NUM_MAX
+ * @return {psu_object_t*} 成功: psu句柄, 失败: NULL
+ */
+psu_object_t *psu_object_alloc(uint32_t psu_num);
+/**
+ * @description: 获取电源个数
+ * @param {psu_object_t*} psu : psu的句柄
+ * @return {uint32_t} 电源个数
+ */
+uint32_t psu_count(psu_object_t *psu);
+/**
+ * @description: 释放句柄
+ * @param {psu_object_t*} psu : psu的句柄
+ */
+void psu_free(psu_object_t *psu);
+/**
+ * @description: 获取电源状态，电源由不在位变为在位时调用后端的 redetect 重新识别该电源，并发调用时只识别一次
+ *               读状态失败(拔出后不应答)按不在位记录，超时退避期间不记录
+ *               同一电源的读取正在进行时，并发的调用等待它完成并返回同一结果，不再访问总线
+ *               超过 psu_deadline_set 设置的截止时间或处于退避期间时返回 -ETIMEDOUT
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @return {double} 成功: HAL_PSU_STAT_ON/HAL_PSU_STAT_OFF/HAL_PSU_STAT_NA, 失败: -errno
+ */
+int psu_status(psu_object_t *psu, uint32_t idx);
+/**
+ * @description: 获取输入功率，并发的调用与 psu_status 一样合并为一次读取
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @return {double} 输入功率，超时或处于退避期间: -ETIMEDOUT
+ */
+double psu_power_input(psu_object_t *psu, uint32_t idx);
+/**
+ * @description: 获取输出功率，并发的调用与 psu_status 一样合并为一次读取
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @return {double} 输出功率，超时或处于退避期间: -ETIMEDOUT
+ */
+double psu_power_output(psu_object_t *psu, uint32_t idx);
+/**
+ * @description: 读取输入电能，电源支持 READ_EIN 时读硬件累加器，否则用输入功率做软件积分
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @param {psu_energy_t*} e: 输出的电能读数
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int psu_energy_input(psu_object_t *psu, uint32_t idx, psu_energy_t *e);
+/**
+ * @description: 读取输出电能，电源支持 READ_EOUT 时读硬件累加器，否则用输出功率做软件积分
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @param {psu_energy_t*} e: 输出的电能读数
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int psu_energy_output(psu_object_t *psu, uint32_t idx, psu_energy_t *e);
+/**
+ * @description: 计算两次电能读数之间的平均功率
+ * @param {const psu_energy_t*} start: 起始读数
+ * @param {const psu_energy_t*} end: 结束读数
+ * @return {double} 平均功率(W)，读数无效时返回0
+ */
+double psu_energy_avg_watts(const psu_energy_t *start, const psu_energy_t *end);
+/**
+ * @description: 计算两次电能读数之间消耗的电能
+ * @param {const psu_energy_t*} start: 起始读数
+ * @param {const psu_energy_t*} end: 结束读数
+ * @return {double} 电能(kWh)
+ */
+double psu_energy_kwh(const psu_energy_t *start, const psu_energy_t *end);
+/**
+ * @description: 读取PMBus电能累加器，供各电源后端使用
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint8_t} slave: 电源地址
+ * @param {uint8_t} cmd: PMBUS_READ_EIN/PMBUS_READ_EOUT
+ * @param {psu_energy_t*} e: 输出的电能读数
+ * @return {int} 成功: 0, 失败: -1
+ */
+int psu_pmbus_energy(psu_object_t *psu, uint8_t slave, uint8_t cmd, psu_energy_t *e);
+/**
+ * @description: 声明某个电源支持的指标，供各电源后端在探测前调用
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @param {int} metric: psu_metric_e
+ * @param {int} cap: PSU_CAP_ASSUMED 或 PSU_CAP_PROBE
+ * @param {uint8_t} cmd: 读取的命令码
+ */
+void psu_plan_declare(psu_object_t *psu, uint32_t idx, int metric, int cap, uint8_t cmd);
+/**
+ * @description: 通过 PMBUS_REVISION/QUERY/COEFFICIENTS 探测各电源实际支持的指标和数据格式，生成读取计划
+ *               设备不支持 QUERY 时保留后端的声明；两个指标都确认不支持电能累加器时直接走软件积分
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {const char*} i2c_dev: 电源所在的i2c设备
+ * @return {int} 成功: 读到 PMBUS_REVISION 的电源个数, 失败: -errno
+ */
+int psu_pmbus_discover(psu_object_t *psu, const char *i2c_dev);
+/**
+ * @description: 电源热插拔后只重新探测这一个电源，读取计划先恢复为后端声明的状态
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @param {const char*} i2c_dev: 电源所在的i2c设备
+ * @return {int} 成功: 1 读到 PMBUS_REVISION, 0 没有读到, 失败: -errno
+ */
+int psu_pmbus_rediscover(psu_object_t *psu, uint32_t idx, const char *i2c_dev);
+/**
+ * @description: 按读取计划读取并解码一个指标，供各电源后端使用
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @param {int} metric: PSU_METRIC_PIN/PSU_METRIC_POUT
+ * @param {double*} val: 解码后的数值
+ * @return {int} 成功: 0, 不支持: -ENOTSUP, 失败: -1
+ */
+int psu_pmbus_read(psu_object_t *psu, uint32_t idx, int metric, double *val);
+/**
+ * @description: 开启SMBALERT#告警模式，之后 psu_status 只在告警到来后重新读状态，其余时间返回缓存
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {int} alert_fd: 告警线的gpio事件fd，测试时可以用eventfd代替，由调用者关闭
+ * @param {const char*} i2c_dev: 电源所在的i2c设备，用于读ARA; NULL表示不读ARA，告警时刷新所有电源
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int psu_alert_enable(psu_object_t *psu, int alert_fd, const char *i2c_dev);
+/**
+ * @description: 关闭告警模式，恢复每次都读状态；等待正在处理告警的调用结束后返回，可与 psu_status 并发
+ * @param {psu_object_t*} psu : psu的句柄
+ */
+void psu_alert_disable(psu_object_t *psu);
+/**
+ * @description: 等待告警，收到告警后通过ARA找到发出告警的电源，重新读取其状态
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {int} timeout_ms: 超时时间，-1表示一直等待
+ * @return {int} 成功: 状态被刷新的电源掩码(bit0为第一个电源), 超时: 0, 失败: -errno
+ */
+int psu_alert_wait(psu_object_t *psu, int timeout_ms);
+/**
+ * @description: 通过SMBus ARA读取发出告警的设备地址，供各电源后端使用
+ * @param {psu_object_t*} psu : psu的句柄
+ * @return {int} 成功: 7位设备地址, 没有设备应答: -1
+ */
+int psu_smbus_ara(psu_object_t *psu);
+/**
+ * @description: 开启或关闭PMBus读取的PEC校验，校验失败的事务会单独重试
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {int} on: 1 开启, 0 关闭
+ */
+void psu_pec_enable(psu_object_t *psu, int on);
+/**
+ * @description: 设置单个电源一次读取的截止时间。总线事务本身无法中途取消，
+ *               超过截止时间返回的结果按过期处理，清空通路缓存让下一次事务重新切通路，
+ *               并在 backoff_ms 内跳过该电源，一个卡住总线的电源每个退避周期最多拖慢一次读取
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} xfer_ms: 截止时间，0表示不限制
+ * @param {uint32_t} backoff_ms: 超时后跳过该电源的时间
+ */
+void psu_deadline_set(psu_object_t *psu, uint32_t xfer_ms, uint32_t backoff_ms);
+/**
+ * @description: 读取电源之前调用，该电源处于超时退避期间时不应访问总线
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @param {uint64_t*} start: 输出读取开始时间，传给 psu_deadline_end
+ * @return {int} 可以读取: 0, 退避期间: -ETIMEDOUT
+ */
+int psu_deadline_begin(psu_object_t *psu, uint32_t idx, uint64_t *start);
+/**
+ * @description: 读取电源之后调用，超过截止时间时进入退避并清空通路缓存
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint32_t} idx: 第几个电源，从0开始
+ * @param {uint64_t} start: psu_deadline_begin 输出的开始时间
+ * @return {int} 未超时: 0, 超时: -ETIMEDOUT，本次读到的结果应按过期处理
+ */
+int psu_deadline_end(psu_object_t *psu, uint32_t idx, uint64_t start);
+/**
+ * @description: 按psu的PEC配置读取PMBus word，供各电源后端使用
+ * @param {psu_object_t*} psu : psu的句柄
+ * @param {uint8_t} slave: 电源地址
+ * @param {uint8_t} cmd: 命令码
+ * @param {uint16_t*} val: 读到的值
+ * @return {int} 成功: 0, 失败: 非0
+ */
+int psu_read_word(psu_object_t *psu, uint8_t slave, uint8_t cmd, uint16_t *val);
+/**
+ * @description: 获取电源类型
+ * @param {psu_object_t*} psu : psu的句柄
+ * @return {double} 电源类型，例如台达，欧陆通，全汉等
+ */
+hal_psu_type_e psu_type(psu_object_t *psu);
+/**
+ * @description: 注册电源匹配规则
+ * @param {psu_match_t**} match: 匹配规则
+ * @param {size} size: 规则长度
+ */
+void psu_register(psu_match_t *match, int size);
+void psu_hwmon_register(void);
+void psu_mmap_register(void);
+void psu_smbus_register(void);
+#if defined __x86_64__ || defined __i386__
+void psu_ioport_register(void);
+#endif
+
 #endif
\ No newline at end of file
@@ -0,0 +1,240 @@
+#include <base/oserror.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "hal_utils_inner.h"
+#include "psu_fru.h"
+
+#define PSU_FRU_MAGIC        0x50465232  // "PFR2"
+#define PSU_CAP_HASH_SIZE    16          // 必须是2的幂，且大于型号个数
+
+typedef struct {
+    uint32_t key;                           // PSU_FRU_SLOT
+    uint32_t used;
+    psu_fru_t fru;
+} psu_fru_slot_t;
+
+typedef struct {
+    uint32_t magic;
+    uint32_t next;                          // 下一个被替换的缓存项
+    uint32_t next_slot;                     // 槽位记录满时下一个被替换的槽位
+    psu_fru_slot_t slot[PSU_FRU_SLOT_MAX];  // 各槽位最近一次识别到的电源
+    psu_fru_t entry[PSU_FRU_CACHE_MAX];     // 按序列号缓存的电源型号
+} psu_fru_cache_t;
+
+static const psu_cap_t psu_cap_table[] = {
+    { "CRPS350S", 720, 350 },
+    { "DPS-300AB-102", 960, 300 },
+    { "U1D-D0550-B", 1440, 550 },
+};
+
+static psu_fru_cache_t psu_fru_cache;
+static int psu_fru_loaded;
+static pthread_mutex_t psu_fru_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint8_t psu_cap_hash[PSU_CAP_HASH_SIZE];  // 存放 psu_cap_table 下标+1, 0表示空
+static pthread_once_t psu_cap_once = PTHREAD_ONCE_INIT;
+
+_Static_assert(HAL_ARRSZ(psu_cap_table) < PSU_CAP_HASH_SIZE, "psu cap hash table too small");
+
+static uint32_t psu_str_hash(const char *str)
+{
+    // FNV-1a
+    uint32_t hash = 2166136261u;
+    while (*str) {
+        hash ^= (uint8_t)*str++;
+        hash *= 16777619u;
+    }
+    return hash;
+}
+
+static void psu_cap_hash_init(void)
+{
+    for (unsigned int i = 0; i < HAL_ARRSZ(psu_cap_table); i++) {
+        uint32_t h = psu_str_hash(psu_cap_table[i].name);
+        while (psu_cap_hash[h & (PSU_CAP_HASH_SIZE - 1)])
+            h++;
+        psu_cap_hash[h & (PSU_CAP_HASH_SIZE - 1)] = i + 1;
+    }
+}
+
+const psu_cap_t *psu_cap_lookup(const char *model)
+{
+    ASSERT_FR(model, NULL, "Invalid argument");
+    pthread_once(&psu_cap_once, psu_cap_hash_init);
+
+    // 1. 型号完全一致时直接命中
+    uint32_t h = psu_str_hash(model);
+    for (uint8_t idx; (idx = psu_cap_hash[h & (PSU_CAP_HASH_SIZE - 1)]) != 0; h++) {
+        if (!strcmp(psu_cap_table[idx - 1].name, model))
+            return &psu_cap_table[idx - 1];
+    }
+
+    // 2. 型号带有前后缀时退化为子串匹配，只在电源识别时发生
+    for (unsigned int i = 0; i < HAL_ARRSZ(psu_cap_table); i++) {
+        if (strstr(model, psu_cap_table[i].name))
+            return &psu_cap_table[i];
+    }
+
+    return NULL;
+}
+
+static void psu_fru_cache_load(void)
+{
+    if (psu_fru_loaded)
+        return;
+    psu_fru_loaded = 1;
+
+    int fd = open(PSU_FRU_CACHE_PATH, O_RDONLY);
+    if (fd < 0)
+        return;
+
+    ssize_t len = read(fd, &psu_fru_cache, sizeof(psu_fru_cache));
+    close(fd);
+    if (len != sizeof(psu_fru_cache) || psu_fru_cache.magic != PSU_FRU_MAGIC) {
+        HAL_DBG("psu fru cache invalid, ignore it");
+        memset(&psu_fru_cache, 0, sizeof(psu_fru_cache));
+    }
+}
+
+static void psu_fru_cache_save(void)
+{
+    psu_fru_cache.magic = PSU_FRU_MAGIC;
+
+    // 先写临时文件再改名，避免掉电后留下半个文件
+    int fd = open(PSU_FRU_CACHE_PATH ".tmp", O_WRONLY | O_CREAT | O_TRUNC, 0644);
+    if (fd < 0) {
+        HAL_DBG("open psu fru cache fail!");
+        return;
+    }
+
+    ssize_t len = write(fd, &psu_fru_cache, sizeof(psu_fru_cache));
+    close(fd);
+    if (len != sizeof(psu_fru_cache)) {
+        HAL_DBG("write psu fru cache fail!");
+        return;
+    }
+
+    if (rename(PSU_FRU_CACHE_PATH ".tmp", PSU_FRU_CACHE_PATH) < 0)
+        HAL_DBG("rename psu fru cache fail!");
+}
+
+// 调用者持有 psu_fru_lock
+static psu_fru_slot_t *psu_fru_slot_find(uint32_t slot, int create)
+{
+    psu_fru_slot_t *free_slot = NULL;
+    for (int i = 0; i < PSU_FRU_SLOT_MAX; i++) {
+        psu_fru_slot_t *s = &psu_fru_cache.slot[i];
+        if (s->used && s->key == slot)
+            return s;
+        if (!s->used && !free_slot)
+            free_slot = s;
+    }
+    if (!create)
+        return NULL;
+
+    if (!free_slot) {
+        free_slot = &psu_fru_cache.slot[psu_fru_cache.next_slot];
+        psu_fru_cache.next_slot = (psu_fru_cache.next_slot + 1) % PSU_FRU_SLOT_MAX;
+    }
+    memset(free_slot, 0, sizeof(*free_slot));
+    free_slot->key = slot;
+    free_slot->used = 1;
+    return free_slot;
+}
+
+int psu_fru_load(uint32_t slot, psu_fru_t *fru)
+{
+    ASSERT_FR(fru, -OS_EINVAL, "Invalid argument");
+
+    int ret = -ENOENT;
+    pthread_mutex_lock(&psu_fru_lock);
+    psu_fru_cache_load();
+    psu_fru_slot_t *s = psu_fru_slot_find(slot, 0);
+    if (s && s->fru.model[0]) {
+        *fru = s->fru;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&psu_fru_lock);
+    return ret;
+}
+
+// 总线出错(通常是电源不在位)返回总线的错误码，读到的字符串为空或无效返回 -ENODATA
+static int psu_fru_read_str(hal_smbus_t *smb, uint8_t slave, uint8_t cmd, char *str)
+{
+    uint8_t buf[PSU_FRU_STR_LEN] = { 0 };
+    int ret = smb->rblock(smb, slave, cmd, buf, PSU_FRU_STR_LEN - 1);
+    ASSERT_FR(ret >= 0, ret < -1 ? ret : -EIO, "read psu fru(0x%x) fail!", cmd);
+    ASSERT_FR(ret > 0, -ENODATA, "psu fru(0x%x) is empty!", cmd);
+
+    // 以 '#' 或不可见字符结尾，去掉尾部的填充空格
+    int len = 0;
+    while (len < ret && buf[len] != '#' && buf[len] >= ' ' && buf[len] < 0x7f)
+        len++;
+    while (len > 0 && buf[len - 1] == ' ')
+        len--;
+    ASSERT_FR(len > 0, -ENODATA, "psu fru(0x%x) is invalid!", cmd);
+
+    memcpy(str, buf, len);
+    str[len] = '\0';
+    return 0;
+}
+
+int psu_fru_refresh(hal_smbus_t *smb, uint8_t slave, uint32_t slot, psu_fru_t *fru)
+{
+    ASSERT_FR(smb && fru, -OS_EINVAL, "Invalid argument");
+
+    memset(fru, 0, sizeof(*fru));
+    strcpy(fru->model, PSU_UNKNOWN_MODEL);
+
+    // 1. 读序列号，读不到就无法使用缓存；总线出错说明电源不响应，不再读型号
+    int ret = psu_fru_read_str(smb, slave, PMBUS_MFR_SERIAL, fru->serial);
+    if (ret < 0) {
+        fru->serial[0] = '\0';
+        if (ret != -ENODATA)
+            return ret;
+        ret = psu_fru_read_str(smb, slave, PMBUS_MFR_MODEL, fru->model);
+        if (ret < 0)
+            strcpy(fru->model, PSU_UNKNOWN_MODEL);
+        return ret;
+    }
+
+    pthread_mutex_lock(&psu_fru_lock);
+    psu_fru_cache_load();
+
+    // 2. 序列号命中缓存，不再读型号
+    psu_fru_t *hit = NULL;
+    for (int i = 0; i < PSU_FRU_CACHE_MAX; i++) {
+        if (!strcmp(psu_fru_cache.entry[i].serial, fru->serial)) {
+            hit = &psu_fru_cache.entry[i];
+            break;
+        }
+    }
+
+    if (hit) {
+        strcpy(fru->model, hit->model);
+    } else {
+        // 3. 新电源, 读型号后放入缓存
+        ret = psu_fru_read_str(smb, slave, PMBUS_MFR_MODEL, fru->model);
+        if (ret < 0) {
+            strcpy(fru->model, PSU_UNKNOWN_MODEL);
+            goto out;
+        }
+        psu_fru_cache.entry[psu_fru_cache.next] = *fru;
+        psu_fru_cache.next = (psu_fru_cache.next + 1) % PSU_FRU_CACHE_MAX;
+    }
+
+    // 4. 记录槽位，下次启动直接使用
+    psu_fru_slot_t *s = psu_fru_slot_find(slot, 1);
+    if (memcmp(&s->fru, fru, sizeof(*fru))) {
+        s->fru = *fru;
+        psu_fru_cache_save();
+    }
+out:
+    pthread_mutex_unlock(&psu_fru_lock);
+    return ret;
+}
@@ -0,0 +1,55 @@
+#ifndef __SXF_PSU_FRU_H__
+#define __SXF_PSU_FRU_H__
+
+#include <stdint.h>
+#include "hal_utils.h"
+
+#define PSU_FRU_STR_LEN      24          // 型号/序列号最大长度(含结尾'\0')
+#define PSU_FRU_SLOT_MAX     16          // 缓存文件记录的槽位个数
+#define PSU_FRU_CACHE_MAX    16          // 按序列号缓存的电源个数
+#define PSU_FRU_CACHE_PATH   "/var/cache/psu_fru.cache"
+#define PSU_UNKNOWN_MODEL    "Unknown"
+
+// 槽位用总线号和电源地址标识，多块单板的电源互不覆盖
+#define PSU_FRU_SLOT(_bus, _slave)  ((((uint32_t)(_bus) & 0xffffff) << 8) | (uint8_t)(_slave))
+
+#define PMBUS_MFR_MODEL      0x9a        // PMBus MFR_MODEL 命令
+#define PMBUS_MFR_SERIAL     0x9e        // PMBus MFR_SERIAL 命令
+
+typedef struct {
+    char model[PSU_FRU_STR_LEN];
+    char serial[PSU_FRU_STR_LEN];
+} psu_fru_t;
+
+// 电源型号对应的能力
+typedef struct psu_cap_t {
+    const char *name;
+    uint32_t in_max_watts;
+    uint32_t out_max_watts;
+} psu_cap_t;
+
+/**
+ * @description: 从缓存文件中获取槽位上次记录的电源信息，不访问总线
+ * @param {uint32_t} slot: 槽位，由 PSU_FRU_SLOT 生成
+ * @param {psu_fru_t*} fru: 输出的电源信息
+ * @return {int} 成功: 0, 没有缓存: -ENOENT
+ */
+int psu_fru_load(uint32_t slot, psu_fru_t *fru);
+/**
+ * @description: 电源在位变化后重新识别槽位上的电源
+ *               先读序列号，序列号命中缓存时直接使用缓存的型号，否则再读型号并写回缓存
+ * @param {hal_smbus_t*} smb: 电源所在总线，调用前需切好通路
+ * @param {uint8_t} slave: 电源地址
+ * @param {uint32_t} slot: 槽位，由 PSU_FRU_SLOT 生成
+ * @param {psu_fru_t*} fru: 输出的电源信息，读取失败时型号为 PSU_UNKNOWN_MODEL
+ * @return {int} 成功: 0, 总线出错(电源不在位): 总线返回的 -errno, 读到的字符串为空或无效: -ENODATA
+ */
+int psu_fru_refresh(hal_smbus_t *smb, uint8_t slave, uint32_t slot, psu_fru_t *fru);
+/**
+ * @description: 根据型号查找电源能力
+ * @param {const char*} model: 电源型号
+ * @return {const psu_cap_t*} 成功: 能力描述, 未知型号: NULL
+ */
+const psu_cap_t *psu_cap_lookup(const char *model);
+
+#endif
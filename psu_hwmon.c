@@ -0,0 +1,368 @@
+#include <base/oserror.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <strings.h>
+#include <limits.h>
+#include <dirent.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include "hal_utils_inner.h"
+#include "psu.h"
+
+#define PSU_HWMON_ROOT          "/sys/class/hwmon"
+#define PSU_HWMON_ROOT_ENV      "HAL_PSU_HWMON_ROOT"    // 测试时指向伪造的sysfs目录
+#define PSU_HWMON_CHAN_MAX      8                       // 每类属性最多扫描的通道
+#define PSU_HWMON_ALARM_MAX     16                      // 每个电源最多打开的告警属性
+#define PSU_HWMON_CACHE_NS      100000000ull            // 一次读取的结果在100ms内复用
+#define PSU_HWMON_VOUT_MIN_MV   1000                    // 输出电压低于该值认为没有输出
+
+// 绑定了这些电源专用驱动的hwmon设备认为是电源
+static const char *psu_hwmon_drivers[] = {
+    "crps", "dps920ab", "fsp3y", "ibm-cffps", "bel-pfe",
+};
+
+// 通用 pmbus 驱动也会绑定VRM、DC-DC等设备，只有同时带输入电压、输入功率和输出功率通道的才认为是电源
+#define PSU_HWMON_GENERIC       "pmbus"
+
+typedef enum {
+    HWMON_VIN,
+    HWMON_VOUT,
+    HWMON_IIN,
+    HWMON_IOUT,
+    HWMON_PIN,
+    HWMON_POUT,
+    HWMON_ATTR_NUM,
+} psu_hwmon_attr_e;
+
+// 属性对应的 pmbus 驱动标签，没有标签时按通道顺序
+static const struct {
+    const char *prefix;
+    const char *label;
+    int chan;
+} psu_hwmon_attrs[HWMON_ATTR_NUM] = {
+    [HWMON_VIN]  = { "in",    "vin",  1 },
+    [HWMON_VOUT] = { "in",    "vout", 2 },
+    [HWMON_IIN]  = { "curr",  "iin",  1 },
+    [HWMON_IOUT] = { "curr",  "iout", 2 },
+    [HWMON_PIN]  = { "power", "pin",  1 },
+    [HWMON_POUT] = { "power", "pout", 2 },
+};
+
+typedef struct {
+    char path[PATH_MAX];
+    pthread_mutex_t lock;               // 保护下面的缓存，并发的状态和功率读取共用一次刷新
+    int fd[HWMON_ATTR_NUM];             // 常开的属性文件，-1表示没有该属性
+    int alarm_fd[PSU_HWMON_ALARM_MAX];  // 电压告警属性
+    int alarm_num;
+    long val[HWMON_ATTR_NUM];           // mV, mA, uW
+    uint8_t ok[HWMON_ATTR_NUM];
+    uint8_t alarm;                      // 是否有告警
+    int err;                            // 最近一次读取是否失败
+    uint64_t ts_ns;                     // 最近一次读取的时间
+} psu_hwmon_dev_t;
+
+typedef struct {
+    uint32_t num;
+    psu_hwmon_dev_t dev[PSU_NUM_MAX];
+} psu_hwmon_t;
+
+static uint64_t psu_hwmon_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static int psu_hwmon_read_str(const char *dir, const char *attr, char *buf, size_t size)
+{
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s", dir, attr);
+
+    int fd = open(path, O_RDONLY);
+    if (fd < 0)
+        return -1;
+    ssize_t len = read(fd, buf, size - 1);
+    close(fd);
+    if (len <= 0)
+        return -1;
+
+    buf[len] = '\0';
+    buf[strcspn(buf, "\n")] = '\0';
+    return 0;
+}
+
+// sysfs 属性从头读即可拿到最新值，不需要重新打开
+static int psu_hwmon_pread(int fd, long *val)
+{
+    char buf[32];
+    ssize_t len = pread(fd, buf, sizeof(buf) - 1, 0);
+    if (len <= 0)
+        return -1;
+
+    buf[len] = '\0';
+    char *end = NULL;
+    *val = strtol(buf, &end, 10);
+    return end == buf ? -1 : 0;
+}
+
+// 按标签查找通道，例如 in1_label 为 vin 时返回1，vout1/iout1/pout1 也算，没有时返回0
+static int psu_hwmon_find_label(const char *dir, psu_hwmon_attr_e attr)
+{
+    char name[64], label[32];
+    for (int i = 1; i <= PSU_HWMON_CHAN_MAX; i++) {
+        snprintf(name, sizeof(name), "%s%d_label", psu_hwmon_attrs[attr].prefix, i);
+        if (psu_hwmon_read_str(dir, name, label, sizeof(label)) < 0)
+            continue;
+        if (!strncasecmp(label, psu_hwmon_attrs[attr].label, strlen(psu_hwmon_attrs[attr].label)))
+            return i;
+    }
+    return 0;
+}
+
+static int psu_hwmon_is_psu(const char *dir)
+{
+    char name[64];
+    if (psu_hwmon_read_str(dir, "name", name, sizeof(name)) < 0)
+        return 0;
+
+    for (unsigned int i = 0; i < HAL_ARRSZ(psu_hwmon_drivers); i++) {
+        if (!strcmp(name, psu_hwmon_drivers[i]))
+            return 1;
+    }
+
+    if (strcmp(name, PSU_HWMON_GENERIC))
+        return 0;
+    return psu_hwmon_find_label(dir, HWMON_VIN) && psu_hwmon_find_label(dir, HWMON_PIN) &&
+           psu_hwmon_find_label(dir, HWMON_POUT);
+}
+
+static int psu_hwmon_open_attr(psu_hwmon_dev_t *dev, psu_hwmon_attr_e attr)
+{
+    const char *prefix = psu_hwmon_attrs[attr].prefix;
+    char name[64], label[32];
+
+    // 1. 按标签查找
+    int chan = psu_hwmon_find_label(dev->path, attr);
+
+    // 2. 没有标签时按 pmbus 驱动的通道顺序
+    if (!chan) {
+        snprintf(name, sizeof(name), "%s%d_label", prefix, psu_hwmon_attrs[attr].chan);
+        if (psu_hwmon_read_str(dev->path, name, label, sizeof(label)) == 0)
+            return -1;
+        chan = psu_hwmon_attrs[attr].chan;
+    }
+
+    char path[PATH_MAX];
+    snprintf(path, sizeof(path), "%s/%s%d_input", dev->path, prefix, chan);
+    return open(path, O_RDONLY);
+}
+
+// 打开电压通道的告警属性，例如 in1_lcrit_alarm, in2_crit_alarm
+static void psu_hwmon_open_alarms(psu_hwmon_dev_t *dev)
+{
+    DIR *dir = opendir(dev->path);
+    if (!dir)
+        return;
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL && dev->alarm_num < PSU_HWMON_ALARM_MAX) {
+        size_t len = strlen(ent->d_name);
+        if (strncmp(ent->d_name, "in", 2) || len < 6 || strcmp(ent->d_name + len - 6, "_alarm"))
+            continue;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", dev->path, ent->d_name);
+        int fd = open(path, O_RDONLY);
+        if (fd >= 0)
+            dev->alarm_fd[dev->alarm_num++] = fd;
+    }
+    closedir(dir);
+}
+
+static void psu_hwmon_close(psu_hwmon_dev_t *dev)
+{
+    for (int i = 0; i < HWMON_ATTR_NUM; i++) {
+        if (dev->fd[i] >= 0)
+            close(dev->fd[i]);
+        dev->fd[i] = -1;
+    }
+    for (int i = 0; i < dev->alarm_num; i++)
+        close(dev->alarm_fd[i]);
+    dev->alarm_num = 0;
+    pthread_mutex_destroy(&dev->lock);
+}
+
+static int psu_hwmon_open(psu_hwmon_dev_t *dev)
+{
+    int found = 0;
+    for (int i = 0; i < HWMON_ATTR_NUM; i++) {
+        dev->fd[i] = psu_hwmon_open_attr(dev, i);
+        found += dev->fd[i] >= 0;
+    }
+    ASSERT_FR(found, -1, "no psu attribute in %s", dev->path);
+
+    psu_hwmon_open_alarms(dev);
+    pthread_mutex_init(&dev->lock, NULL);
+    return 0;
+}
+
+// 一次读完电源的全部属性，同一轮扫描中状态和功率共用一次读取，调用时需持有 dev->lock
+static int psu_hwmon_refresh(psu_hwmon_dev_t *dev)
+{
+    uint64_t now = psu_hwmon_now_ns();
+    if (dev->ts_ns && now - dev->ts_ns < PSU_HWMON_CACHE_NS)
+        return dev->err;
+
+    int ok = 0;
+    for (int i = 0; i < HWMON_ATTR_NUM; i++) {
+        dev->ok[i] = dev->fd[i] >= 0 && psu_hwmon_pread(dev->fd[i], &dev->val[i]) == 0;
+        ok += dev->ok[i];
+    }
+
+    dev->alarm = 0;
+    for (int i = 0; i < dev->alarm_num; i++) {
+        long val = 0;
+        if (psu_hwmon_pread(dev->alarm_fd[i], &val) == 0 && val)
+            dev->alarm = 1;
+    }
+
+    // 电源拔出后驱动读属性会返回错误
+    dev->err = ok ? 0 : -1;
+    dev->ts_ns = now;
+    return dev->err;
+}
+
+static int psu_hwmon_status(psu_object_t *psu, uint32_t idx)
+{
+    ASSERT_FR(psu && psu->priv && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    psu_hwmon_dev_t *dev = &((psu_hwmon_t *)psu->priv)->dev[idx];
+
+    pthread_mutex_lock(&dev->lock);
+    int ret = psu_hwmon_refresh(dev);
+    int st = HAL_PSU_STAT_ON;
+    if (dev->alarm || (dev->ok[HWMON_VOUT] && dev->val[HWMON_VOUT] < PSU_HWMON_VOUT_MIN_MV))
+        st = HAL_PSU_STAT_OFF;
+    pthread_mutex_unlock(&dev->lock);
+
+    ASSERT_FR(ret == 0, -1, "read psu%u hwmon fail!", idx + 1);
+    return st;
+}
+
+static double psu_hwmon_watts(psu_object_t *psu, uint32_t idx, psu_hwmon_attr_e attr)
+{
+    ASSERT_FR(psu && psu->priv && idx < psu->psu_num, -1, "Invalid argument");
+    psu_hwmon_dev_t *dev = &((psu_hwmon_t *)psu->priv)->dev[idx];
+
+    pthread_mutex_lock(&dev->lock);
+    double watts = -1;
+    if (psu_hwmon_refresh(dev) == 0 && dev->ok[attr])
+        watts = dev->val[attr] / 1000000.0;
+    pthread_mutex_unlock(&dev->lock);
+    return watts;
+}
+
+static double psu_hwmon_pin(psu_object_t *psu, uint32_t idx)
+{
+    return psu_hwmon_watts(psu, idx, HWMON_PIN);
+}
+
+static double psu_hwmon_pout(psu_object_t *psu, uint32_t idx)
+{
+    return psu_hwmon_watts(psu, idx, HWMON_POUT);
+}
+
+static void free_psu_hwmon(psu_object_t *psu)
+{
+    if (!psu) {
+        HAL_DBG("free_psu_hwmon fail!");
+        return;
+    }
+
+    psu_hwmon_t *hw = psu->priv;
+    for (uint32_t i = 0; hw && i < hw->num; i++)
+        psu_hwmon_close(&hw->dev[i]);
+    free(hw);
+    free(psu);
+}
+
+// 按设备路径排序，保证电源序号与总线地址顺序一致，而不是hwmon的注册顺序
+static int psu_hwmon_cmp(const void *a, const void *b)
+{
+    return strcmp(((const psu_hwmon_dev_t *)a)->path, ((const psu_hwmon_dev_t *)b)->path);
+}
+
+static int psu_hwmon_scan(psu_hwmon_t *hw)
+{
+    const char *root = getenv(PSU_HWMON_ROOT_ENV) ?: PSU_HWMON_ROOT;
+    DIR *dir = opendir(root);
+    ASSERT_FR(dir, -1, "open %s fail!", root);
+
+    struct dirent *ent;
+    while ((ent = readdir(dir)) != NULL && hw->num < PSU_NUM_MAX) {
+        if (ent->d_name[0] == '.')
+            continue;
+
+        char path[PATH_MAX];
+        snprintf(path, sizeof(path), "%s/%s", root, ent->d_name);
+        if (!psu_hwmon_is_psu(path))
+            continue;
+
+        psu_hwmon_dev_t *dev = &hw->dev[hw->num++];
+        if (!realpath(path, dev->path))
+            snprintf(dev->path, sizeof(dev->path), "%s", path);
+    }
+    closedir(dir);
+
+    qsort(hw->dev, hw->num, sizeof(hw->dev[0]), psu_hwmon_cmp);
+    return hw->num ? 0 : -1;
+}
+
+static psu_object_t *alloc_psu_hwmon()
+{
+    psu_hwmon_t *hw = calloc(1, sizeof(psu_hwmon_t));
+    ASSERT_FR(hw, NULL, "malloc fail!");
+
+    psu_object_t *psu = NULL;
+    int ret = psu_hwmon_scan(hw);
+    ASSERT_FG(ret == 0, fail, "no pmbus hwmon device!");
+
+    for (uint32_t i = 0; i < hw->num; i++) {
+        ret = psu_hwmon_open(&hw->dev[i]);
+        if (ret < 0) {
+            hw->num = i;
+            goto fail;
+        }
+    }
+
+    psu = psu_object_alloc(hw->num);
+    ASSERT_FG(psu, fail, "malloc fail!");
+
+    psu->type = HAL_PSU_UNKNOW;
+    psu->priv = hw;
+    psu->free = free_psu_hwmon;
+    psu->status = psu_hwmon_status;
+    psu->pin = psu_hwmon_pin;
+    psu->pout = psu_hwmon_pout;
+    return psu;
+fail:
+    for (uint32_t i = 0; i < hw->num; i++)
+        psu_hwmon_close(&hw->dev[i]);
+    free(hw);
+    return NULL;
+}
+
+// 内核驱动已经接管电源时优先使用，没有时继续匹配直接访问总线的后端
+static psu_match_t psu_match_table[] = {
+    {
+        .family = { HAL_FAMILY_ALL },
+        .match = { alloc_psu_hwmon, NULL },
+    },
+};
+
+void psu_hwmon_register(void)
+{
+    psu_register(psu_match_table, HAL_ARRSZ(psu_match_table));
+}
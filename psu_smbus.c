@@ -1,242 +1,347 @@
-#include <base/oserror.h>
-#include <stdio.h>
-#include <stdlib.h>
-#include <stdint.h>
-#include "hal_utils_inner.h"
-#include "hal_i2c.h"
-#include "hal_hwinfo.h"
-#include "psu.h"
-
-
-static psu_object_t *alloc_psu_smb()
-{
-    psu_object_t *psu = calloc(sizeof(psu_object_t), 1);
-    ASSERT_FR(psu, NULL, "malloc fail!");
-
-    char devname[HAL_NAME_MAX] = { 0 };
-    snprintf(devname, sizeof(devname), "/dev/i2c-%d", i2c_get_bus());
-    hal_smbus_t *smb = hal_smbus_alloc(devname, 0, 0);
-    ASSERT_FG(smb, fail, "smbus init fail!");
-
-    psu->smb = smb;
-
-    return psu;
-fail:
-    free(psu);
-    return NULL;
-}
-
-static void free_psu_smb(psu_object_t *psu)
-{
-    if (!psu || !psu->smb) {
-        HAL_DBG("free_psu_smb fail!");
-        return;
-    }
-
-    hal_smbus_t *smb = psu->smb;
-    smb->free(smb);
-    free(psu);
-}
-
-#define PSU_OULUTONG_REG_ADDR     0x79
-#define PSU_OULUTONG_POWER1_SLAVE 0x58
-#define PSU_OULUTONG_POWER2_SLAVE 0x59
-#define PSU_OULUTONG_POWER_REG    0x03
-#define PSU_OULUTONG_POWER1_VALUE 0x46
-#define PSU_OULUTONG_POWER2_VALUE 0x6c
-
-static int psu_smb_read_word(psu_object_t *psu, uint32_t idx)
-{
-    ASSERT_FR(psu && psu->smb && idx < PSU_NUM, -OS_EINVAL, "Invalid argument");
-    int slave = psu->reg[idx].slave;
-    int addr = psu->reg[idx].addr;
-    hal_smbus_t *smb = psu->smb;
-    uint16_t status = 0;
-
-    int ret = smb->read_word(smb, slave, addr, &status);
-    ASSERT_FR(!ret, -1, "Smbus read power(%d) status fail!", psu->type);
-    return status;
-}
-
-static int psu_luma_oulutong_status(psu_object_t *psu, uint32_t idx)
-{
-    int psu_status = 0;
-    int status = psu_smb_read_word(psu, idx);
-    if (status < 0)
-        return status;
-
-    int value = (idx == 0 ? PSU_OULUTONG_POWER1_VALUE : PSU_OULUTONG_POWER2_VALUE);
-    /* 如果是0x2008，供应商的解释是电源发生过一些输入不稳定，或其他内部错误。先清理状态后再次判断 */
-    if (0x2008 == (status & 0xffff)) {
-        psu->smb->write_r(psu->smb, psu->reg[idx].slave, PSU_OULUTONG_POWER_REG, &value, 1);
-        psu_status = HAL_PSU_STAT_ON;
-    } else if (0x0 == (status & 0xff)) {
-        psu_status = HAL_PSU_STAT_ON;
-    } else {
-        psu_status = HAL_PSU_STAT_OFF;
-    }
-    return psu_status;
-}
-
-static psu_object_t *alloc_psu_luma_oulutong()
-{
-    psu_object_t *psu = alloc_psu_smb();
-    if (!psu)
-        return psu;
-
-    psu->reg[0].slave = PSU_OULUTONG_POWER1_SLAVE;
-    psu->reg[0].addr = PSU_OULUTONG_REG_ADDR;
-
-    psu->reg[1].slave = PSU_OULUTONG_POWER2_SLAVE;
-    psu->reg[1].addr = PSU_OULUTONG_REG_ADDR;
-
-    psu->type = HAL_PSU_OULUTONG;
-    psu->free = free_psu_smb;
-    psu->status = psu_luma_oulutong_status;
-    return psu;
-}
-
-#define PSU_OULUTONG_POUT_REG 0x96
-#define PSU_OULUTONG_PIN_REG  0x97
-
-static int psu_xeme_oulutong_status(psu_object_t *psu, uint32_t idx)
-{
-    int status = psu_smb_read_word(psu, idx);
-    if (status < 0)
-        return status;
-
-    if (HAL_BIT(6) & status)
-        return HAL_PSU_STAT_OFF;
-    else
-        return HAL_PSU_STAT_ON;
-}
-
-static double psu_oulutong_lineal_value(psu_object_t *psu, int slave, int reg)
-{
-    ASSERT_FR(psu && psu->smb, -OS_EINVAL, "Invalid argument");
-
-    hal_smbus_t *smb = psu->smb;
-    uint16_t d16;
-    int ret = smb->read_word(smb, slave, PSU_OULUTONG_REG_ADDR, &d16);
-    ASSERT_FR(!ret, -1, "Smbus read power(oulutong 150w) power value fail!");
-
-    return psu_lineal_value(d16);
-}
-
-static double psu_oulutong_pin(psu_object_t *psu, uint32_t idx)
-{
-    int slave = (idx == 0 ? PSU_OULUTONG_POWER1_SLAVE : PSU_OULUTONG_POWER2_SLAVE);
-    return psu_oulutong_lineal_value(psu, slave, PSU_OULUTONG_PIN_REG);
-}
-
-static double psu_oulutong_pout(psu_object_t *psu, uint32_t idx)
-{
-    int slave = (idx == 0 ? PSU_OULUTONG_POWER1_SLAVE : PSU_OULUTONG_POWER2_SLAVE);
-    return psu_oulutong_lineal_value(psu, slave, PSU_OULUTONG_POUT_REG);
-}
-
-static psu_object_t *alloc_psu_xeme_oulutong()
-{
-    psu_object_t *psu = alloc_psu_smb();
-    if (!psu)
-        return psu;
-
-    psu->reg[0].slave = PSU_OULUTONG_POWER1_SLAVE;
-    psu->reg[0].addr = PSU_OULUTONG_REG_ADDR;
-
-    psu->reg[1].slave = PSU_OULUTONG_POWER2_SLAVE;
-    psu->reg[1].addr = PSU_OULUTONG_REG_ADDR;
-
-    psu->type = HAL_PSU_OULUTONG;
-    psu->free = free_psu_smb;
-    psu->status = psu_xeme_oulutong_status;
-    psu->pin = psu_oulutong_pin;
-    psu->pout = psu_oulutong_pout;
-
-    return psu;
-}
-
-#define PSU_TAIDA_SLAVE 0x25
-#define PSU_TAIDA_REG   0xe0
-#define PSU_TAIDA_POUT  0x96
-
-static int psu_taida_status(psu_object_t *psu, uint32_t idx)
-{
-    int status = psu_smb_read_word(psu, idx);
-    if (status < 0)
-        return status;
-
-    uint8_t flag1 = status & (idx == 0 ? HAL_BIT(5) : HAL_BIT(4));
-    uint8_t flag2 = status & (idx == 0 ? HAL_BIT(2) : HAL_BIT(1));
-
-    // N/A 状态
-    if (!flag2)
-        return HAL_PSU_STAT_NA;
-    // off 状态
-    if (flag1)
-        return HAL_PSU_STAT_OFF;
-
-    return HAL_PSU_STAT_ON;
-}
-
-static double psu_taida_pout(psu_object_t *psu, uint32_t idx)
-{
-    ASSERT_FR(psu && psu->smb && idx == 0, -OS_EINVAL, "Invalid argument");
-    hal_smbus_t *smb = psu->smb;
-    uint16_t data = 0;
-    int ret = smb->read_word(smb, PSU_TAIDA_SLAVE, PSU_TAIDA_POUT, &data);
-    ASSERT_FR(!ret, 0, "Smbus read power(taida) status fail!");
-
-    return psu_lineal_value(data);
-}
-
-static psu_object_t *alloc_psu_taida()
-{
-    psu_object_t *psu = alloc_psu_smb();
-    if (!psu)
-        return psu;
-
-    psu->reg[0].slave = PSU_TAIDA_SLAVE;
-    psu->reg[0].addr = PSU_TAIDA_REG;
-
-    psu->reg[1].slave = PSU_TAIDA_SLAVE;
-    psu->reg[1].addr = PSU_TAIDA_REG;
-
-    psu->type = HAL_PSU_TAIDA;
-    psu->free = free_psu_smb;
-    psu->status = psu_taida_status;
-    psu->pout = psu_taida_pout;
-    return psu;
-}
-
-static psu_match_t psu_match_table[] = {
-    {
-        .family = { "sxf", "tina" },
-        .match = { alloc_psu_taida, alloc_psu_luma_oulutong, NULL },
-    },
-    {
-        .family = { "sxf", "tina1" },
-        .match = { alloc_psu_taida, alloc_psu_luma_oulutong, NULL },
-    },
-    {
-        .family = { "sxf", "mona" },
-        .match = { alloc_psu_taida, alloc_psu_luma_oulutong, NULL },
-    },
-    {
-        .family = { "sxf", "xeme" },
-        .match = { alloc_psu_taida, alloc_psu_xeme_oulutong, NULL },
-    },
-    {
-        .family = { "sxf", "dota" },
-        .match = { alloc_psu_taida, alloc_psu_xeme_oulutong, NULL },
-    },
-    {
-        .family = { "sxf", "dota1" },
-        .match = { alloc_psu_taida, alloc_psu_xeme_oulutong, NULL },
-    },
-};
-
-void psu_smbus_register(void)
-{
-    psu_register(psu_match_table, HAL_ARRSZ(psu_match_table));
-}
\ No newline at end of file
+#include <base/oserror.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <errno.h>
+#include <time.h>
+#include "hal_utils_inner.h"
+#include "hal_i2c.h"
+#include "hal_hwinfo.h"
+#include "psu.h"
+
+#define PSU_SMB_CACHE_NS    100000000ull    // 一次批量读取的结果在100ms内复用
+
+// 状态字需要额外写命令才能恢复的情况，例如先清故障再判断
+typedef struct {
+    uint16_t mask;
+    uint16_t match;                         // (status & mask) == match 时触发
+    uint8_t reg;                            // 写入的寄存器
+    uint8_t value[PSU_NUM];                 // 每个电源写入的值
+    uint8_t stat;                           // 写入后上报的状态
+} psu_smb_quirk_t;
+
+// 厂商描述，新增电源型号只需要增加一项
+typedef struct {
+    hal_psu_type_e type;
+    uint8_t slave[PSU_NUM];
+    uint8_t status_reg;
+    uint16_t present_mask[PSU_NUM];         // 这些位全为0时不在位，0表示不判断
+    uint16_t off_mask[PSU_NUM];             // 任意一位为1时关闭
+    psu_smb_quirk_t quirk;                  // mask 为0表示没有
+    uint8_t cap[PSU_NUM][PSU_METRIC_NUM];   // psu_cap_e，读标准PMBus命令
+} psu_smb_profile_t;
+
+// 一次批量读取的结果
+typedef struct {
+    uint64_t ts_ns;                         // 功率的读取时间，0表示需要重新读
+    int status;
+    double power[2];                        // [输入, 输出]，不支持为0，失败为-1
+} psu_smb_cache_t;
+
+typedef struct {
+    const psu_smb_profile_t *prof;
+    psu_smb_cache_t cache[PSU_NUM];
+} psu_smb_priv_t;
+
+// 读取计划中各指标对应的标准命令
+static const uint8_t psu_smb_cmd[PSU_METRIC_NUM] = {
+    [PSU_METRIC_PIN]  = PMBUS_READ_PIN,
+    [PSU_METRIC_POUT] = PMBUS_READ_POUT,
+    [PSU_METRIC_EIN]  = PMBUS_READ_EIN,
+    [PSU_METRIC_EOUT] = PMBUS_READ_EOUT,
+};
+
+// 台达: 两个电源共用一个控制器地址，只有总输出功率和总电能，都只在电源1上声明，避免累加两次
+static const psu_smb_profile_t psu_profile_taida = {
+    .type = HAL_PSU_TAIDA,
+    .slave = { 0x25, 0x25 },
+    .status_reg = 0xe0,
+    .present_mask = { HAL_BIT(2), HAL_BIT(1) },
+    .off_mask = { HAL_BIT(5), HAL_BIT(4) },
+    .cap = {
+        { [PSU_METRIC_POUT] = PSU_CAP_ASSUMED, [PSU_METRIC_EIN] = PSU_CAP_ASSUMED,
+          [PSU_METRIC_EOUT] = PSU_CAP_ASSUMED },
+        { 0 },
+    },
+};
+
+// 欧陆通(luma): 只确认过状态寄存器，功率和电能探测到支持才读
+// 0x2008 是电源发生过输入不稳定或其他内部错误，先清理状态后按在位处理
+static const psu_smb_profile_t psu_profile_luma_oulutong = {
+    .type = HAL_PSU_OULUTONG,
+    .slave = { 0x58, 0x59 },
+    .status_reg = PMBUS_STATUS_WORD,
+    .off_mask = { 0x00ff, 0x00ff },
+    .quirk = {
+        .mask = 0xffff,
+        .match = 0x2008,
+        .reg = 0x03,
+        .value = { 0x46, 0x6c },
+        .stat = HAL_PSU_STAT_ON,
+    },
+    .cap = {
+        { PSU_CAP_PROBE, PSU_CAP_PROBE, PSU_CAP_PROBE, PSU_CAP_PROBE },
+        { PSU_CAP_PROBE, PSU_CAP_PROBE, PSU_CAP_PROBE, PSU_CAP_PROBE },
+    },
+};
+
+// 欧陆通(xeme): 标准PMBus电源，STATUS_WORD bit6(OFF) 表示关闭
+static const psu_smb_profile_t psu_profile_xeme_oulutong = {
+    .type = HAL_PSU_OULUTONG,
+    .slave = { 0x58, 0x59 },
+    .status_reg = PMBUS_STATUS_WORD,
+    .off_mask = { HAL_BIT(6), HAL_BIT(6) },
+    .cap = {
+        { PSU_CAP_ASSUMED, PSU_CAP_ASSUMED, PSU_CAP_ASSUMED, PSU_CAP_ASSUMED },
+        { PSU_CAP_ASSUMED, PSU_CAP_ASSUMED, PSU_CAP_ASSUMED, PSU_CAP_ASSUMED },
+    },
+};
+
+static uint64_t psu_smb_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+static void psu_smb_devname(char *devname, size_t size)
+{
+    snprintf(devname, size, "/dev/i2c-%d", i2c_get_bus());
+}
+
+// psu_free 在关闭告警、销毁锁之后调用，创建到一半失败时 smb、sched、priv 可能为空
+static void free_psu_smb(psu_object_t *psu)
+{
+    if (!psu) {
+        HAL_DBG("free_psu_smb fail!");
+        return;
+    }
+
+    if (psu->smb)
+        psu->smb->free(psu->smb);
+    smbus_sched_put(psu->sched);
+    free(psu->priv);
+    free(psu);
+}
+
+static int psu_smb_decode_status(psu_object_t *psu, uint32_t idx, uint16_t status)
+{
+    psu_smb_priv_t *priv = psu->priv;
+    const psu_smb_profile_t *prof = priv->prof;
+    const psu_smb_quirk_t *q = &prof->quirk;
+
+    if (q->mask && (status & q->mask) == q->match) {
+        uint8_t value = q->value[idx];
+        psu->smb->write_r(psu->smb, psu->slot[idx].reg.slave, q->reg, &value, 1);
+        return q->stat;
+    }
+    if (prof->present_mask[idx] && !(status & prof->present_mask[idx]))
+        return HAL_PSU_STAT_NA;
+    if (status & prof->off_mask[idx])
+        return HAL_PSU_STAT_OFF;
+    return HAL_PSU_STAT_ON;
+}
+
+static double psu_smb_read_power(psu_object_t *psu, uint32_t idx, int metric)
+{
+    double val = 0;
+    int ret = psu_pmbus_read(psu, idx, metric, &val);
+    // 不支持的指标返回0，与没有该读取接口时一致
+    if (ret == -ENOTSUP)
+        return 0;
+    return ret ? -1 : val;
+}
+
+// 只读状态字，调用者需已获取总线；读失败或状态变化时作废功率缓存
+static int psu_smb_read_status(psu_object_t *psu, uint32_t idx, psu_smb_cache_t *c)
+{
+    uint16_t status = 0;
+    int ret = psu_read_word(psu, psu->slot[idx].reg.slave, psu->slot[idx].reg.addr, &status);
+    if (ret) {
+        c->ts_ns = 0;
+        HAL_ERR("Smbus read power(%d) status fail!", psu->type);
+        return -1;
+    }
+
+    int stat = psu_smb_decode_status(psu, idx, status);
+    if (stat != c->status)
+        c->ts_ns = 0;
+    c->status = stat;
+    return stat;
+}
+
+// 一次占用总线读完一个电源的状态和功率，之后的 pin/pout 在缓存有效期内不再访问总线
+// 电源不在开启状态时不读功率，功率为0；缓存只在持有总线时读写，调用者需已获取总线
+static int psu_smb_refresh(psu_object_t *psu, uint32_t idx)
+{
+    psu_smb_priv_t *priv = psu->priv;
+    psu_smb_cache_t *c = &priv->cache[idx];
+    uint64_t now = psu_smb_now_ns();
+    if (c->ts_ns && now - c->ts_ns < PSU_SMB_CACHE_NS)
+        return 0;
+
+    // 读不到状态时功率也不可信，不缓存，下次重新读
+    if (psu_smb_read_status(psu, idx, c) < 0)
+        return -1;
+    c->power[0] = c->power[1] = 0;
+    if (c->status == HAL_PSU_STAT_ON) {
+        c->power[0] = psu_smb_read_power(psu, idx, PSU_METRIC_PIN);
+        c->power[1] = psu_smb_read_power(psu, idx, PSU_METRIC_POUT);
+    }
+    c->ts_ns = psu_smb_now_ns();
+    return 0;
+}
+
+// 排在其它总线请求后面检查缓存，缓存过期时在同一次占用中刷新，拿到的值不会被并发的刷新改写
+static double psu_smb_power(psu_object_t *psu, uint32_t idx, int out)
+{
+    psu_smb_priv_t *priv = psu->priv;
+    int ret = smbus_sched_acquire(psu->sched, SMBUS_PRIO_NORMAL, 0);
+    ASSERT_FR(ret == 0, -1, "psu bus busy!");
+
+    double watts = psu_smb_refresh(psu, idx) == 0 ? priv->cache[idx].power[out] : -1;
+    smbus_sched_release(psu->sched);
+    return watts;
+}
+
+// 状态总是重新读且只读状态字，告警模式下告警到来后不能拿到旧状态，功率等到 pin/pout 时再读
+static int psu_smb_status(psu_object_t *psu, uint32_t idx)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    psu_smb_priv_t *priv = psu->priv;
+
+    int ret = smbus_sched_acquire(psu->sched, SMBUS_PRIO_URGENT, 0);
+    ASSERT_FR(ret == 0, -1, "psu bus busy!");
+    ret = psu_smb_read_status(psu, idx, &priv->cache[idx]);
+    smbus_sched_release(psu->sched);
+    return ret;
+}
+
+static double psu_smb_pin(psu_object_t *psu, uint32_t idx)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    return psu_smb_power(psu, idx, 0);
+}
+
+static double psu_smb_pout(psu_object_t *psu, uint32_t idx)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    return psu_smb_power(psu, idx, 1);
+}
+
+static int psu_smb_energy(psu_object_t *psu, uint32_t idx, int out, psu_energy_t *e)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    const psu_plan_t *plan = &psu->slot[idx].plan[out ? PSU_METRIC_EOUT : PSU_METRIC_EIN];
+    if (plan->cap != PSU_CAP_ASSUMED && plan->cap != PSU_CAP_YES)
+        return -ENOTSUP;
+    return psu_pmbus_energy(psu, psu->slot[idx].reg.slave, plan->cmd, e);
+}
+
+// 换上了新电源，重新探测读取计划，之前批量读到的功率作废
+static int psu_smb_redetect(psu_object_t *psu, uint32_t idx)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    psu_smb_priv_t *priv = psu->priv;
+
+    char devname[HAL_NAME_MAX] = { 0 };
+    psu_smb_devname(devname, sizeof(devname));
+    int ret = psu_pmbus_rediscover(psu, idx, devname);
+    if (smbus_sched_acquire(psu->sched, SMBUS_PRIO_NORMAL, 0) == 0) {
+        priv->cache[idx].ts_ns = 0;
+        smbus_sched_release(psu->sched);
+    }
+    return ret < 0 ? ret : 0;
+}
+
+// 候选胜出后探测一次，生成实际的读取计划
+static int psu_smb_discover(psu_object_t *psu)
+{
+    char devname[HAL_NAME_MAX] = { 0 };
+    psu_smb_devname(devname, sizeof(devname));
+    return psu_pmbus_discover(psu, devname);
+}
+
+static psu_object_t *alloc_psu_profile(const psu_smb_profile_t *prof)
+{
+    psu_object_t *psu = psu_object_alloc(PSU_NUM);
+    ASSERT_FR(psu, NULL, "malloc fail!");
+    psu->free = free_psu_smb;
+
+    char devname[HAL_NAME_MAX] = { 0 };
+    psu_smb_devname(devname, sizeof(devname));
+    psu_smb_priv_t *priv = calloc(1, sizeof(psu_smb_priv_t));
+    ASSERT_FG(priv, fail, "malloc fail!");
+    priv->prof = prof;
+    psu->priv = priv;
+
+    hal_smbus_t *smb = hal_smbus_alloc(devname, 0, 0);
+    ASSERT_FG(smb, fail, "smbus init fail!");
+    psu->smb = smb;
+    psu->sched = smbus_sched_get(devname);
+
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++) {
+        psu->slot[idx].reg.slave = prof->slave[idx];
+        psu->slot[idx].reg.addr = prof->status_reg;
+        for (int m = 0; m < PSU_METRIC_NUM; m++) {
+            if (prof->cap[idx][m] != PSU_CAP_NONE)
+                psu_plan_declare(psu, idx, m, prof->cap[idx][m], psu_smb_cmd[m]);
+        }
+    }
+
+    psu->type = prof->type;
+    psu->status = psu_smb_status;
+    psu->pin = psu_smb_pin;
+    psu->pout = psu_smb_pout;
+    psu->energy = psu_smb_energy;
+    psu->ara = psu_smbus_ara;
+    psu->redetect = psu_smb_redetect;
+    psu->discover = psu_smb_discover;
+    return psu;
+fail:
+    psu_free(psu);
+    return NULL;
+}
+
+#define PSU_SMB_ALLOC(_name)                                 \
+    static psu_object_t *alloc_psu_##_name()                 \
+    {                                                        \
+        return alloc_psu_profile(&psu_profile_##_name);      \
+    }
+
+PSU_SMB_ALLOC(taida)
+PSU_SMB_ALLOC(luma_oulutong)
+PSU_SMB_ALLOC(xeme_oulutong)
+
+// 候选都在同一条电源总线上，并行探测会被总线串行化，按顺序探测
+static psu_match_t psu_match_table[] = {
+    {
+        .family = { "sxf", "tina" },
+        .match = { alloc_psu_taida, alloc_psu_luma_oulutong, NULL },
+    },
+    {
+        .family = { "sxf", "tina1" },
+        .match = { alloc_psu_taida, alloc_psu_luma_oulutong, NULL },
+    },
+    {
+        .family = { "sxf", "mona" },
+        .match = { alloc_psu_taida, alloc_psu_luma_oulutong, NULL },
+    },
+    {
+        .family = { "sxf", "xeme" },
+        .match = { alloc_psu_taida, alloc_psu_xeme_oulutong, NULL },
+    },
+    {
+        .family = { "sxf", "dota" },
+        .match = { alloc_psu_taida, alloc_psu_xeme_oulutong, NULL },
+    },
+    {
+        .family = { "sxf", "dota1" },
+        .match = { alloc_psu_taida, alloc_psu_xeme_oulutong, NULL },
+    },
+};
+
+void psu_smbus_register(void)
+{
+    psu_register(psu_match_table, HAL_ARRSZ(psu_match_table));
+}
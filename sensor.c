@@ -1,459 +1,1391 @@
-#include <stdio.h>
-#include <stdlib.h>
-#include <unistd.h>
-#include <sys/types.h>
-#include <sys/stat.h>
-#include <sys/mman.h>
-#include <string.h>
-#include <errno.h>
-#include <fcntl.h>
-#include <base/oserror.h>
-#include <sys/ioctl.h>
-#include <linux/i2c-dev.h>
-#include <linux/i2c.h>
-#include "hal.h"
-#include "hal_utils_inner.h"
-#include "hal_sensor.h"
-#include "psu.h"
-#include "hal_i2c.h"
-#include "yudi.h"
-#include "hal_protocol.h"
-
-#define SENSOR_SLAVE        0x40    // 默认的sensor设备地址
-#define EXT_REG_ADDR        0x00    // 切换到扩展寄存器的地址
-#define EXT_REG_DATA        0x01    // 切换到扩展寄存器要写入值
-
-// 电源相关
-#define CRPS_SLAVE          0x70    // 切换到CRPS通路的设备地址
-#define CRPS_REG_ADDR       0x00    // 切换到CRPS通路的设备寄存器地址
-#define CRPS_REG_DATA       0x20    // 切换到CRPS通路的设备寄存器要写入值
-#define PSU1_ADDR           0x58    // PSU1的设备地址
-#define PSU2_ADDR           0x59    // PSU2的设备地址
-#define PSU_REG_ADDR        0x9a    // PSU model的寄存器地址
-#define PSU_MAX_MODEL_LEN   14      // 读取PSU型号的最大长度
-#define PSU_UNKNOWN_MODEL   "Unknown"
-
-typedef struct {
-    hal_sensor_id_e id;            // 传感器的名称id
-    hal_sensor_type_e type;        // 传感器的类型
-    uint8_t offset_h;              // 读取寄存器高字节偏移量
-    uint8_t offset_l;              // 读取寄存器低字节偏移量
-    double factor;                 // 读取后的系数
-    uint8_t slave;                 // 传感器设备地址
-    double min;                    // 传感器的最小值
-    double max;                    // 传感器的最大值
-} sensor_object_t;
-
-typedef struct {
-    psu_object_t *psu;
-    char psu1_model[PSU_MAX_MODEL_LEN];
-    char psu2_model[PSU_MAX_MODEL_LEN];
-    uint8_t status[PSU_NUM];
-    hal_smbus_t *smb;
-    // 连接Switch fan 和 Netcard fan的总线
-    hal_smbus_t *smb_fan;
-    size_t obj_num;
-    sensor_object_t objs[];
-} sensor_drv_t;
-
-typedef struct psu_model_info_t {
-    const char *name;
-    uint32_t psu_in_max_watts;
-    uint32_t psu_out_max_watts;
-} psu_model_info_t;
-
-static psu_model_info_t psu_model_info[] = {
-    { "CRPS350S", 720, 350 },
-    { "DPS-300AB-102", 960, 300 },
-    { "U1D-D0550-B", 1440, 550 },
-};
-
-static inline int sensor_write_byte(hal_smbus_t *smb, sensor_object_t *obj, uint8_t offset, uint8_t data)
-{
-    int ret;
-    if (obj->slave != SENSOR_SLAVE) { // CPLD
-        ret = smb->write_r(smb, obj->slave, offset, &data, 1);
-        ASSERT_FR(ret == 1, -1, "CPLD write failed! slave: 0x%x, offset: 0x%x", obj->slave, offset);
-    } else { // MCU
-        hal_proto_t *hp = hal_proto_alloc(smb, SENSOR_SLAVE, MCU_PROTO_V1);
-        ASSERT_FR(hp, -1, "MCU proto alloc for write failed.");
-        ret = hal_proto_write(hp, offset, &data, 1);
-        hal_proto_free(hp);
-        ASSERT_FR(ret == 0, -1, "MCU write failed! offset: 0x%x", offset);
-    }
-    return 0;
-}
-
-static inline int sensor_read_byte(hal_smbus_t *smb, sensor_object_t *obj, uint8_t offset, uint8_t *val)
-{
-    int ret;
-    if (obj->slave != SENSOR_SLAVE) { // CPLD
-        ret = smb->read_r(smb, obj->slave, offset, val, 1);
-        ASSERT_FR(ret == 1, -1, "CPLD read failed! slave: 0x%x, offset: 0x%x", obj->slave, offset);
-    } else { // MCU
-        hal_proto_t *hp = hal_proto_alloc(smb, SENSOR_SLAVE, MCU_PROTO_V1);
-        ASSERT_FR(hp, -1, "MCU proto alloc for read failed.");
-
-        ret = hal_proto_read(hp, offset, val, 1);
-        hal_proto_free(hp);
-        ASSERT_FR(ret == 0, -1, "MCU read failed! offset: 0x%x", offset);
-    }
-    return 0;
-}
-
-
-static inline int switch_to_extend_register(hal_smbus_t *smb, sensor_object_t *obj)
-{
-    // 如果是SWITCH_FAN或者NETCARD_FAN, 不需要切扩展寄存器
-    if(obj->id == HAL_SEN_FAN_SWITCH || obj->id == HAL_SEN_FAN_NETCARD)
-        return 0;
-    
-    return sensor_write_byte(smb, obj, EXT_REG_ADDR, EXT_REG_DATA);
-}
-
-static int sensor_get_val(hal_smbus_t *smb, sensor_object_t *obj, uint8_t offset, uint8_t *val)
-{
-    ASSERT_FR(smb && obj && val, -1, "Invalid argument");
-    
-    int ret = switch_to_extend_register(smb, obj);
-    ASSERT_FR(ret == 0, -1, "switch to extend register failed!");
-
-    ret = sensor_read_byte(smb, obj, offset, val);
-    ASSERT_FR(ret == 0, -1, "sensor get val failed!");
-
-    return 0;
-}
-
-static double sensor_get_temp(sensor_drv_t *drv, sensor_object_t *obj)
-{
-    hal_smbus_t *smb = drv->smb;
-    uint8_t temp = 0;
-    int ret = sensor_get_val(smb, obj, obj->offset_l, &temp);
-    ASSERT_FR(ret == 0, 0, "smbus read temp failed!");
-    
-    return temp * obj->factor;
-}
-
-static double sensor_get_vol_fan(sensor_drv_t *drv, sensor_object_t *obj)
-{
-    hal_smbus_t *smb = drv->smb;
-    // 如果是SWITCH_FANAN或者NETCARD_FAN, 需要使用另一条总线
-    if(obj->id == HAL_SEN_FAN_SWITCH || obj->id == HAL_SEN_FAN_NETCARD)
-        smb = drv->smb_fan;
-
-    uint8_t val_l = 0, val_h = 0;
-    int ret = sensor_get_val(smb, obj, obj->offset_l, &val_l);
-    ASSERT_FR(ret == 0, 0, "smbus read vol low addr failed!");
-
-    ret = sensor_get_val(smb, obj, obj->offset_h, &val_h);
-    ASSERT_FR(ret == 0, 0, "smbus read vol high addr failed!");
-
-    return (val_h*16*16 + val_l) * obj->factor;
-}
-
-static inline int switch_to_crps(hal_smbus_t *smb)
-{
-#ifdef xtest
-    return 1;
-#endif
-    uint8_t data = CRPS_REG_DATA;
-    return smb->write_r(smb, CRPS_SLAVE, CRPS_REG_ADDR, &data, 1);
-}
-
-static int sensor_get_psu_model(sensor_drv_t *drv, hal_smbus_t *smb, uint32_t psu_addr)
-{
-    // 1. 先切换CRPS通路
-    int ret = switch_to_crps(smb);
-    ASSERT_FR(ret == 1, -1, "switch to CRPS failed!");
-
-    // 2. 向对应的PSU的地址设置寄存器地址， 然后读取14个字节
-    char *psu_model = psu_addr == PSU1_ADDR ? drv->psu1_model : drv->psu2_model;
-    ret = smb->rblock(smb, psu_addr, PSU_REG_ADDR, (uint8_t *)psu_model, PSU_MAX_MODEL_LEN);
-    // 获取失败默认设置为PSU_UNKNOWN_MODEL， 后面做进一步处理
-    if (ret != PSU_MAX_MODEL_LEN) {
-        HAL_DBG("get PSU model failed, set to CRPS350S");
-        strcpy(psu_model, PSU_UNKNOWN_MODEL);
-        return 0;
-    }
-
-    // 3. 将读取到的14个字节转换成字符串
-    for (int i = 0; i < PSU_MAX_MODEL_LEN; i++) {
-        if (psu_model[i] == '#') {
-            psu_model[i] = '\0';
-            break;
-        }
-    }
-
-    return 0;
-}
-
-static int sensor_get_psu_max_watts(char *model, int out)
-{
-#ifdef xtest
-    return 1;
-#endif
-    for (unsigned int i = 0; i < HAL_ARRSZ(psu_model_info); i++) {
-        if (strstr(model, psu_model_info[i].name)) {
-            if (out)
-                return psu_model_info[i].psu_out_max_watts;
-            else
-                return psu_model_info[i].psu_in_max_watts;
-        }
-    }
-
-    return -1;
-}
-
-static int sensor_get_psu_in_max_watts(char *model)
-{
-    return sensor_get_psu_max_watts(model, 0);
-}
-
-static int sensor_get_psu_out_max_watts(char *model)
-{
-    return sensor_get_psu_max_watts(model, 1);
-}
-
-
-static int sensor_get_psu_status(psu_object_t *psu, sensor_object_t *obj)
-{
-    hal_smbus_t *smb = psu->smb;
-    uint16_t val = 0;
-    // 1、先切换到CRPS通路
-    int ret = switch_to_crps(smb);
-    ASSERT_FR(ret == 1, -1, "switch to CRPS failed!");
-
-    // 2、获取状态
-    ret = smb->read_word(smb, obj->slave, obj->offset_l, &val);
-    if (ret != 0) {
-        HAL_DBG("Smbus read power status fail, setting psu offline");
-        return HAL_PSU_STAT_OFF;
-    }
-
-    // 3、通过POWER_GOOD# bit位确认是否在位，0表示在位，1表示不在位
-    return (HAL_BIT(11) & val) ? HAL_PSU_STAT_OFF : HAL_PSU_STAT_ON;
-}
-
-static int sensor_get_psu_watts(psu_object_t *psu, sensor_object_t *obj)
-{
-    hal_smbus_t *smb = psu->smb;
-    uint16_t val = 0;
-    // 1、先切换到CRPS通路
-    int ret = switch_to_crps(smb);
-    ASSERT_FR(ret == 1, -1, "switch to CRPS failed!");
-
-    // 2、获取功率
-    ret = smb->read_word(smb, obj->slave, obj->offset_l, &val);
-    ASSERT_FR(!ret, -1, "Smbus read power watts fail!");
-
-    return val;
-}
-
-static void sensor_info(sensor_drv_t *drv, size_t num, hal_data_t *data)
-{
-    sensor_object_t *obj = drv->objs + num;
-    double value = 0.0;
-
-    switch (obj->type) {
-    case HAL_SEN_TEMP:
-        value = sensor_get_temp(drv, obj);
-        break;
-    case HAL_SEN_FAN:
-    case HAL_SEN_VOL:
-        value = sensor_get_vol_fan(drv, obj);
-        break;
-    case HAL_SEN_DISCRETE: {
-        // 获取电源状态
-        int pst = sensor_get_psu_status(drv->psu, obj);
-        ASSERT_FG(pst != -1, out, "Smbus read psu staus fail!");
-        PSU_SET_STAT(drv->status, obj->id, (uint8_t)pst);
-        hal_sensor_data(data, obj->id, obj->type, 0, 0, 0, hal_psu_stat(pst));
-        return;
-    }
-
-    case HAL_SEN_WATTS:
-        if (PSU_GET_STAT(drv->status, obj->id) == HAL_PSU_STAT_ON) {
-            int ret = sensor_get_psu_watts(drv->psu, obj);
-            ASSERT_FG(ret != -1, out, "Smbus read psu watts fail!");
-            uint16_t d16 = (uint16_t)ret & 0xffff;
-            value = psu_lineal_value(d16);
-        }
-        break;
-    default:
-        HAL_ERR("error object type");
-    }
-
-    hal_sensor_data(data, obj->id, obj->type, obj->min, obj->max, value, NULL);
-out:
-    return;
-}
-
-static int sensor_iter(hal_device_sensor_t *dev, hal_iter_sensor_t cb, void *priv)
-{
-    ASSERT_FR(dev && cb, -OS_EINVAL, "Invalid argument");
-    hal_data_t *data = hal_data_alloc();
-    sensor_drv_t *drv = dev->priv;
-
-    int ret = 0;
-    for (size_t i = 0; i < drv->obj_num; ++i) {
-        sensor_info(drv, i, data);
-        ret = cb(data, priv);
-        ASSERT_FG(ret == 0, out, "");
-    }
-
-out:
-    data->free(data);
-    return ret;
-}
-
-static void sensor_close(struct hal_device_t *dev)
-{
-    sensor_drv_t *drv = dev->priv;
-
-    if (drv->smb)
-        drv->smb->free(drv->smb);
-
-    if (drv->smb_fan)
-        drv->smb_fan->free(drv->smb_fan);
-    
-    if (drv->psu) {
-        if (drv->psu->smb)
-            drv->psu->smb->free(drv->psu->smb);
-        free(drv->psu);
-    }
-}
-
-static sensor_drv_t sensor_drv = {
-    .obj_num = 18,
-    .objs    = {
-        {.type = HAL_SEN_TEMP,  .id = HAL_SEN_TEMP_CPU0,    .factor = 1.0,   .slave = 0x40, .offset_l = 0x24,  .min = 0,  .max = 85 },
-        {.type = HAL_SEN_TEMP,  .id = HAL_SEN_TEMP_SYS0,    .factor = 1.0,   .slave = 0x40, .offset_l = 0x22,  .min = 0,  .max = 60 },
-        // 设备背面风扇
-        {.type = HAL_SEN_FAN,   .id = HAL_SEN_FAN_SYS1,     .factor = 1.0,   .slave = 0x59, .offset_l = 0x24,  .offset_h = 0x25,   .min = 0,       .max = 4900 * 1.3 },
-        {.type = HAL_SEN_FAN,   .id = HAL_SEN_FAN_SYS2,     .factor = 1.0,   .slave = 0x59, .offset_l = 0x26,  .offset_h = 0x27,   .min = 0,       .max = 4900 * 1.3 },
-        // 交换芯片风扇
-        {.type = HAL_SEN_FAN,   .id = HAL_SEN_FAN_SWITCH,   .factor = 1.0,   .slave = 0x40, .offset_l = 0x31,  .offset_h = 0x30,   .min = 0,       .max = 4800 * 1.3 },
-        // E810 芯片风扇
-        {.type = HAL_SEN_FAN,   .id = HAL_SEN_FAN_NETCARD,  .factor = 1.0,   .slave = 0x40, .offset_l = 0x33,  .offset_h = 0x32,   .min = 0,       .max = 5000 * 1.3 },
-        {.type = HAL_SEN_FAN,   .id = HAL_SEN_FAN_CPU1,     .factor = 1.0,   .slave = 0x59, .offset_l = 0x28,  .offset_h = 0x29,   .min = 0,       .max = 6600 * 1.3 },
-        {.type = HAL_SEN_VOL,   .id = HAL_SEN_VOL_CPU,      .factor = 0.001, .slave = 0x40, .offset_l = 0x11,  .offset_h = 0x10,   .min = 0.865,   .max = 0.955  },
-        {.type = HAL_SEN_VOL,   .id = HAL_SEN_VOL_DDR,      .factor = 0.001, .slave = 0x40, .offset_l = 0x13,  .offset_h = 0x12,   .min = 1.14,     .max = 1.26 },
-        {.type = HAL_SEN_VOL,   .id = HAL_SEN_VOL_3_3V,     .factor = 0.001, .slave = 0x40, .offset_l = 0x15,  .offset_h = 0x14,   .min = 3,       .max = 3.6  },
-        {.type = HAL_SEN_VOL,   .id = HAL_SEN_VOL_5V,       .factor = 0.001, .slave = 0x40, .offset_l = 0x19,  .offset_h = 0x18,   .min = 4.5,     .max = 5.5 },
-        {.type = HAL_SEN_VOL,   .id = HAL_SEN_VOL_12V,      .factor = 0.001, .slave = 0x40, .offset_l = 0x21,  .offset_h = 0x20,   .min = 10.8,    .max = 13.2 },
-
-        {.type = HAL_SEN_DISCRETE, .id = HAL_SEN_PSU_STATUS1, .factor = 1.0,   .slave = 0x58, .offset_l = 0x79},
-        {.type = HAL_SEN_DISCRETE, .id = HAL_SEN_PSU_STATUS2, .factor = 1.0,   .slave = 0x59, .offset_l = 0x79},
-        {.type = HAL_SEN_WATTS,    .id = HAL_SEN_PSU_POUT1,   .factor = 1.0,   .slave = 0x58, .offset_l = 0x96, .min = 0, .max = 350},
-        {.type = HAL_SEN_WATTS,    .id = HAL_SEN_PSU_POUT2,   .factor = 1.0,   .slave = 0x59, .offset_l = 0x96, .min = 0, .max = 350},
-        {.type = HAL_SEN_WATTS,    .id = HAL_SEN_PSU_PIN1,    .factor = 1.0,   .slave = 0x58, .offset_l = 0x97, .min = 0, .max = 1440},
-        {.type = HAL_SEN_WATTS,    .id = HAL_SEN_PSU_PIN2,    .factor = 1.0,   .slave = 0x59, .offset_l = 0x97, .min = 0, .max = 1440},
-    },
-};
-
-static hal_sensor_method_t sensor_method = { .iter = sensor_iter };
-static hal_device_sensor_t sensor_dev = {
-    HACL_DEVICE(HAL_TAG_DEV_SENSOR, NULL, NULL, sensor_close),
-    .method = &sensor_method,
-};
-
-
-static int sensor_psu_init(sensor_drv_t *drv)
-{
-    psu_object_t *psu = calloc(sizeof(psu_object_t), 1);
-    ASSERT_FR(psu, -1, "malloc fail!");
-
-    char devname[HAL_NAME_MAX] = { 0 };
-    snprintf(devname, sizeof(devname), "/dev/i2c-%d", hal_find_i2c_bus(YUDI_PSU_BUS));
-    const char *i2c_devname = hal_getenv(HAL_ENV_SMBUS_DEV) ?: devname;
-
-    hal_smbus_t *smb = hal_smbus_alloc(i2c_devname, 0, 0);
-    ASSERT_FG(smb, err, "smbus init fail!");
-
-    psu->smb = smb;
-    drv->psu = psu;
-
-  
-    // 将未获取到的电源型号设置为另一电源型号
-    if (strncmp(drv->psu1_model, drv->psu2_model, strlen(drv->psu1_model)) != 0) {
-        if (strncmp(drv->psu1_model, PSU_UNKNOWN_MODEL, strlen(drv->psu1_model)) == 0)
-            strcpy(drv->psu1_model, drv->psu2_model);
-        else if (strncmp(drv->psu2_model, PSU_UNKNOWN_MODEL, strlen(drv->psu2_model)) == 0)
-            strcpy(drv->psu2_model, drv->psu1_model);
-    }
-
-    // 根据PSU型号修改功率范围信息
-    for (unsigned int i = 0; i < sensor_drv.obj_num; i++) {
-        switch (sensor_drv.objs[i].id)
-        {
-        case HAL_SEN_PSU_POUT1:
-            ret = sensor_get_psu_out_max_watts(drv->psu1_model);
-            ASSERT_FG(ret > 0, err, "get psu max watts fail!");
-            drv->objs[i].max = ret;
-            break;
-        case HAL_SEN_PSU_POUT2:
-            ret = sensor_get_psu_out_max_watts(drv->psu2_model);
-            ASSERT_FG(ret > 0, err, "get psu max watts fail!");
-            drv->objs[i].max = ret;
-            break;
-        case HAL_SEN_PSU_PIN1:
-            ret = sensor_get_psu_in_max_watts(drv->psu1_model);
-            ASSERT_FG(ret > 0, err, "get psu max watts fail!");
-            drv->objs[i].max = ret;
-            break;
-        case HAL_SEN_PSU_PIN2:
-            ret = sensor_get_psu_in_max_watts(drv->psu2_model);
-            ASSERT_FG(ret > 0, err, "get psu max watts fail!");
-            drv->objs[i].max = ret;
-            break;
-        default:
-            break;
-        }
-    }
-
-    return 0;
-err:
-    free(psu);
-    return -1;
-}
-
-HAL_API hal_device_t *sensor_open(hal_module_t __attribute__((unused)) *hm, 
-                                  hal_family_t __attribute__((unused)) *family)
-{
-    HAL_BUG_ON_OPEN(sensor_open);
-
-    sensor_drv_t *drv = &sensor_drv;
-    hal_device_sensor_t *dev = &sensor_dev;
-
-    // 初始化获取sensor信息的smbus
-    char devname[HAL_NAME_MAX] = { 0 };
-    snprintf(devname, sizeof(devname), "/dev/i2c-%d", hal_find_i2c_bus(YUDI_SENSOR_BUS));
-
-    const char *i2c_devname = hal_getenv(HAL_ENV_SMBUS_DEV) ?: devname;
-    drv->smb = hal_smbus_alloc(i2c_devname, SENSOR_SLAVE, 0);
-    ASSERT_FR(drv->smb, NULL, "sensor smbus init fail!");
-
-    snprintf(devname, sizeof(devname), "/dev/i2c-%d", hal_find_i2c_bus(YUDI_BUS));
-    drv->smb_fan = hal_smbus_alloc(i2c_devname, SENSOR_SLAVE, 0);
-    ASSERT_FR(drv->smb_fan, NULL, "sensor smbus init fail!");
-
-    // 初始化获取psu的smbus
-    int ret = sensor_psu_init(drv);
-    ASSERT_FG(ret == 0, err, "psu smbus init fail!");
-
-    dev->priv = drv;
-    return (hal_device_t *)dev;
-err:
-    drv->smb->free(drv->smb);
-    drv->smb_fan->free(drv->smb_fan);
-    return NULL;
-}
-
-HAL_DECL_MODULE(sensor) = {
-    HAL_MODULE("sensor", HAL_TAG_MOD_DEVICE, sensor_open, HAL_FLG_MUTEX),
-    .family_cnt = 1,
-    .family = { { "sxf", "yudi", ""} },
-};
-
-
-
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <sys/types.h>
+#include <sys/stat.h>
+#include <sys/mman.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <base/oserror.h>
+#include <sys/ioctl.h>
+#include <linux/i2c-dev.h>
+#include <linux/i2c.h>
+#include "hal.h"
+#include "hal_utils_inner.h"
+#include "hal_sensor.h"
+#include "psu.h"
+#include "hal_i2c.h"
+#include "yudi.h"
+#include "hal_protocol.h"
+#include "sensor_table.h"
+#include "psu_fru.h"
+#include "sensor.h"
+#include "smbus_sched.h"
+#include "smbus_arb.h"
+
+#define SENSOR_SLAVE        0x40    // 默认的sensor设备地址
+#define EXT_REG_ADDR        0x00    // 切换到扩展寄存器的地址
+#define EXT_REG_DATA        0x01    // 切换到扩展寄存器要写入值
+
+// 电源相关
+#define CRPS_SLAVE          0x70    // 切换到CRPS通路的设备地址
+#define CRPS_REG_ADDR       0x00    // 切换到CRPS通路的设备寄存器地址
+#define CRPS_REG_DATA       0x20    // 切换到CRPS通路的设备寄存器要写入值
+#define CRPS_POUT_REG       0x96    // PMBus READ_POUT
+#define CRPS_PIN_REG        0x97    // PMBus READ_PIN
+
+// 一个传感器本次扫描的结果
+typedef struct {
+    double value;
+    double max;                         // 读取时的上限，电源型号变化后会更新
+    int state;                          // 电源状态，非电源状态传感器为-1
+    uint8_t ok;                         // 是否读取成功
+    uint8_t stale;                      // 因超过截止时间没有读取
+    sensor_stamp_t stamp;               // 读取该传感器的总线事务的起止时间
+} sensor_sample_t;
+
+// 增量上报时记录的上次上报内容
+typedef struct {
+    double value;
+    double max;
+    int state;
+    uint8_t ok;
+    uint8_t valid;                      // 是否上报过
+    uint64_t ts_ms;                     // 上次上报的时间
+} sensor_last_t;
+
+// 告警引擎中单个传感器的状态
+typedef struct {
+    uint8_t level;                      // sensor_alarm_level_e，当前已确认的告警
+    uint8_t pending;                    // 待确认的告警
+    uint8_t count;                      // 待确认告警已连续出现的次数
+} sensor_alarm_t;
+
+// 一次遍历在 lock 内暂存的读数和告警事件，解锁后再回调，回调中可以再次调用本设备的接口
+typedef struct {
+    sensor_sample_t s[SENSOR_OBJ_MAX];
+    sensor_mask_t report;               // 待上报的传感器，上报后清除对应的位
+    sensor_alarm_event_t ev[SENSOR_OBJ_MAX];
+    size_t ev_num;
+    sensor_alarm_cb_t alarm_cb;         // 暂存时的告警回调，解锁后重新配置不影响本次
+    void *alarm_priv;
+} sensor_batch_t;
+
+// 单个电源在传感器设备中的状态
+typedef struct {
+    psu_fru_t fru;                      // 型号和序列号，由 lock 保护
+    psu_fru_t fru_new;                  // redetect 重新识别的结果，下一次扫描在 lock 内发布
+    uint8_t fru_pending;                // fru_new 待发布，fru_new 和它由 stage_lock 保护
+    uint8_t status;
+    uint8_t status_ok;                  // 本次扫描是否读到了状态
+    uint8_t status_valid;               // status 是否已经读到过
+    uint8_t stale;                      // 本次扫描因超过截止时间没有读到状态
+    uint64_t ts[2];                     // 本次扫描读状态的起止时间
+} sensor_psu_t;
+
+// 每次 sensor_open 创建一个实例，多块单板可以各自打开、并行轮询
+typedef struct {
+    hal_device_sensor_t dev;
+    const sensor_platform_t *plat;
+    psu_object_t *psu;
+    int psu_bus;                        // 电源所在的i2c总线号，用于区分电源信息缓存的槽位
+    char psu_dev[HAL_NAME_MAX];         // 电源所在的i2c设备，探测读取计划和读ARA时使用
+    sensor_psu_t psus[SENSOR_PSU_MAX];  // 按电源序号连续存放
+    hal_smbus_t *smb;
+    // 连接Switch fan 和 Netcard fan的总线
+    hal_smbus_t *smb_fan;
+    hal_proto_t *mcu;                   // 传感器总线MCU的协议对象，打开时创建，只在扫描中使用
+    hal_proto_t *mcu_fan;               // 风扇总线MCU的协议对象
+    hal_data_t *data_pool[SENSOR_DATA_POOL]; // 遍历回调用的上报对象，打开时分配
+    uint32_t data_busy;                 // data_pool 的占用位图，原子操作
+    smbus_sched_t *sched;               // 传感器总线的请求队列
+    smbus_sched_t *sched_fan;           // 风扇总线的请求队列
+    smbus_arb_t *arb;                   // 传感器总线的跨进程仲裁
+    smbus_arb_t *arb_fan;
+    double max[SENSOR_OBJ_MAX];         // 传感器最大值，电源功率上限依赖电源型号
+    uint8_t burst_ok[SENSOR_BURST_MAX]; // 本次扫描中区间是否读取成功
+    uint8_t buf[SENSOR_BUF_MAX];        // 本次扫描读到的寄存器值
+    uint16_t raw[SENSOR_OBJ_MAX];       // 本次扫描读到的PMBus原始值
+    uint8_t obj_ok[SENSOR_OBJ_MAX];     // 本次扫描PMBus传感器是否读取成功
+    uint64_t burst_ts[SENSOR_BURST_MAX][2]; // 本次扫描各区间读取的起止时间
+    uint64_t obj_ts[SENSOR_OBJ_MAX][2]; // 本次扫描PMBus传感器读取的起止时间
+    uint64_t seq;                       // 扫描次数
+    uint64_t sweep_ns;                  // 本次扫描开始的时间
+    sensor_deadline_cfg_t dl_cfg;       // 扫描和单次读取的截止时间
+    uint64_t sweep_end_ns;              // 本次扫描的截止时刻
+    uint64_t burst_hold[SENSOR_BURST_MAX]; // 区间读取超时后，在此之前不再读取
+    uint8_t burst_stale[SENSOR_BURST_MAX]; // 本次扫描中区间因超时没有读到
+    uint8_t obj_stale[SENSOR_OBJ_MAX];  // 本次扫描中PMBus传感器因超时没有读到
+    pthread_mutex_t lock;               // 扫描和解析缓存期间持有，采样线程和调用者可以同时使用
+    pthread_mutex_t stage_lock;         // 保护 psus[].fru_new，redetect 可能在扫描持有 lock 时被调用，不能用 lock
+    sensor_reading_t stage[SENSOR_OBJ_MAX]; // 本次扫描的读数，扫描结束后一次发布到快照
+    pthread_mutex_t snap_lock;          // 保护 snap，等待者不和扫描争用 lock
+    pthread_cond_t snap_cond;           // 每次发布快照广播一次
+    sensor_snapshot_t snap;
+    sensor_mask_t flight_mask;          // 正在进行的扫描覆盖的传感器，0表示没有，由 snap_lock 保护
+    uint64_t flight_seq;                // 正在进行的扫描序号
+    sensor_sample_t pub[SENSOR_OBJ_MAX]; // 最近一次发布的扫描结果，共用扫描的调用者原样上报，由 snap_lock 保护
+    sensor_mask_t pub_mask;             // pub 中有效的传感器
+    sensor_delta_cfg_t delta_cfg;       // 增量上报的死区和心跳
+    sensor_last_t last[SENSOR_OBJ_MAX]; // 增量上报时上次上报的内容
+    sensor_alarm_cfg_t alarm_cfg;       // 告警回差、去抖和回调，cb为NULL时不检查
+    sensor_alarm_t alarm[SENSOR_OBJ_MAX];
+} sensor_drv_t;
+
+_Static_assert(SENSOR_OBJ_MAX <= SENSOR_SNAP_MAX, "snapshot too small");
+_Static_assert(SENSOR_DATA_POOL <= 32, "data_busy too small");
+
+static uint64_t sensor_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// hp 为打开时创建的MCU协议对象，扫描期间复用，不再每次读写分配
+static inline int sensor_write_byte(hal_smbus_t *smb, hal_proto_t *hp, uint8_t slave, uint8_t offset, uint8_t data)
+{
+    int ret;
+    if (slave != SENSOR_SLAVE) { // CPLD
+        ret = smb->write_r(smb, slave, offset, &data, 1);
+        ASSERT_FR(ret == 1, -1, "CPLD write failed! slave: 0x%x, offset: 0x%x", slave, offset);
+    } else { // MCU
+        ret = hal_proto_write(hp, offset, &data, 1);
+        ASSERT_FR(ret == 0, -1, "MCU write failed! offset: 0x%x", offset);
+    }
+    return 0;
+}
+
+static inline int sensor_read_bytes(hal_smbus_t *smb, hal_proto_t *hp, uint8_t slave, uint8_t offset,
+                                    uint8_t *val, uint8_t len)
+{
+    int ret;
+    if (slave != SENSOR_SLAVE) { // CPLD
+        ret = smb->read_r(smb, slave, offset, val, len);
+        ASSERT_FR(ret == len, -1, "CPLD read failed! slave: 0x%x, offset: 0x%x", slave, offset);
+    } else { // MCU
+        ret = hal_proto_read(hp, offset, val, len);
+        ASSERT_FR(ret == 0, -1, "MCU read failed! offset: 0x%x", offset);
+    }
+    return 0;
+}
+
+static int sensor_read_burst(sensor_drv_t *drv, const sensor_burst_t *burst)
+{
+    int fan = burst->access == SENSOR_ACC_FAN;
+    hal_smbus_t *smb = fan ? drv->smb_fan : drv->smb;
+    hal_proto_t *hp = fan ? drv->mcu_fan : drv->mcu;
+    smbus_sched_t *sched = fan ? drv->sched_fan : drv->sched;
+    smbus_arb_t *arb = fan ? drv->arb_fan : drv->arb;
+
+    // 温度风扇属于批量读取，每个区间单独排队，不会长时间挡住电源查询
+    int ret = smbus_sched_acquire(sched, SMBUS_PRIO_BULK, 0);
+    ASSERT_FR(ret == 0, -1, "sensor bus busy!");
+
+    // 切扩展寄存器和读取之间不让其它进程插入
+    ret = smbus_arb_lock(arb);
+    ASSERT_FG(ret == 0, unlock, "sensor bus locked by others!");
+
+    // 风扇总线上的MCU不需要切扩展寄存器
+    if (!fan) {
+        ret = sensor_write_byte(smb, hp, burst->slave, EXT_REG_ADDR, EXT_REG_DATA);
+        ASSERT_FG(ret == 0, out, "switch to extend register failed!");
+    }
+
+    // 整个区间一次读完
+    ret = sensor_read_bytes(smb, hp, burst->slave, burst->start, drv->buf + burst->buf_off, burst->len);
+    ASSERT_FG(ret == 0, out, "sensor read burst failed! slave: 0x%x, start: 0x%x", burst->slave, burst->start);
+
+out:
+    smbus_arb_unlock(arb);
+unlock:
+    smbus_sched_release(sched);
+    return ret == 0 ? 0 : -1;
+}
+
+// 本次扫描已超过截止时间时返回1，剩余的读取不再访问总线
+static int sensor_sweep_expired(sensor_drv_t *drv)
+{
+    return drv->dl_cfg.sweep_ms && sensor_now_ns() >= drv->sweep_end_ns;
+}
+
+// 区间读取超过截止时间时进入退避，读到的内容按过期处理
+// 扩展寄存器每次读取前都会重新切换，不需要额外恢复
+static int sensor_burst_late(sensor_drv_t *drv, size_t i)
+{
+    uint64_t cost = drv->burst_ts[i][1] - drv->burst_ts[i][0];
+    if (!drv->dl_cfg.xfer_ms || cost <= (uint64_t)drv->dl_cfg.xfer_ms * 1000000ull)
+        return 0;
+
+    const sensor_burst_t *burst = drv->plat->bursts + i;
+    HAL_ERR("sensor burst 0x%x:0x%x took %llu ms, skip it for %u ms", burst->slave, burst->start,
+            (unsigned long long)(cost / 1000000), drv->dl_cfg.backoff_ms);
+    drv->burst_hold[i] = drv->burst_ts[i][1] + (uint64_t)drv->dl_cfg.backoff_ms * 1000000ull;
+    return 1;
+}
+
+// 只读被选中的传感器所在的区间
+static void sensor_sweep_bursts(sensor_drv_t *drv, sensor_mask_t mask)
+{
+    const sensor_platform_t *plat = drv->plat;
+    uint32_t need = 0;
+
+    for (size_t i = 0; i < plat->obj_num; i++) {
+        if (mask & HAL_BIT(i))
+            need |= HAL_BIT(plat->objs[i].burst);
+    }
+
+    for (size_t i = 0; i < plat->burst_num; ++i) {
+        const sensor_burst_t *burst = plat->bursts + i;
+        drv->burst_ok[i] = 0;
+        drv->burst_stale[i] = 0;
+        // PMBus 设备按寄存器读取，依赖电源状态，在 sensor_sweep_psu 中处理
+        if (burst->access == SENSOR_ACC_PMBUS || !(need & HAL_BIT(i)))
+            continue;
+        if (sensor_sweep_expired(drv) || sensor_now_ns() < drv->burst_hold[i]) {
+            drv->burst_stale[i] = 1;
+            continue;
+        }
+        drv->burst_ts[i][0] = sensor_now_ns();
+        drv->burst_ok[i] = sensor_read_burst(drv, burst) == 0;
+        drv->burst_ts[i][1] = sensor_now_ns();
+        if (sensor_burst_late(drv, i)) {
+            drv->burst_ok[i] = 0;
+            drv->burst_stale[i] = 1;
+        }
+    }
+}
+
+static double sensor_get_temp(sensor_drv_t *drv, const sensor_object_t *obj)
+{
+    ASSERT_FR(drv->burst_ok[obj->burst], 0, "smbus read temp failed!");
+
+    return drv->buf[obj->idx_l] * obj->factor;
+}
+
+static double sensor_get_vol_fan(sensor_drv_t *drv, const sensor_object_t *obj)
+{
+    ASSERT_FR(drv->burst_ok[obj->burst], 0, "smbus read vol/fan failed!");
+
+    uint8_t val_l = drv->buf[obj->idx_l], val_h = drv->buf[obj->idx_h];
+    return (val_h*16*16 + val_l) * obj->factor;
+}
+
+static inline int switch_to_crps(psu_object_t *psu)
+{
+#ifdef xtest
+    return 1;
+#endif
+    // 仲裁器记录了mux的当前通路，所有进程都通过它切换，通路没变时不再写
+    // 没有仲裁器时看不到其它进程的切换，每次都写
+    if (smbus_arb_mux_selected(psu->arb, CRPS_SLAVE, CRPS_REG_DATA))
+        return 1;
+
+    uint8_t data = CRPS_REG_DATA;
+    int ret = psu->smb->write_r(psu->smb, CRPS_SLAVE, CRPS_REG_ADDR, &data, 1);
+    if (ret == 1)
+        smbus_arb_mux_set(psu->arb, CRPS_SLAVE, CRPS_REG_DATA);
+    else
+        smbus_arb_mux_invalidate(psu->arb);
+    return ret;
+}
+
+// 排队获取电源总线并切到CRPS通路，切通路和之后的读取之间不让本进程和其它进程的请求插入
+// 成功后需要调用 sensor_crps_end 释放总线
+static int sensor_crps_begin(psu_object_t *psu, int prio)
+{
+    int ret = smbus_sched_acquire(psu->sched, prio, 0);
+    ASSERT_FR(ret == 0, -1, "psu bus busy!");
+
+    ret = smbus_arb_lock(psu->arb);
+    ASSERT_FG(ret == 0, release, "psu bus locked by others!");
+
+    ret = switch_to_crps(psu);
+    ASSERT_FG(ret == 1, unlock, "switch to CRPS failed!");
+    return 0;
+unlock:
+    smbus_arb_unlock(psu->arb);
+release:
+    smbus_sched_release(psu->sched);
+    return -1;
+}
+
+// fail 非0表示通路后面的事务失败，通路可能被仲裁器以外的写入者改过，释放总线前清空通路缓存
+static inline void sensor_crps_end(psu_object_t *psu, int fail)
+{
+    if (fail)
+        smbus_arb_mux_invalidate(psu->arb);
+    smbus_arb_unlock(psu->arb);
+    smbus_sched_release(psu->sched);
+}
+
+static int sensor_get_psu_model(sensor_drv_t *drv, uint32_t idx, uint8_t slave, psu_fru_t *fru)
+{
+    hal_smbus_t *smb = drv->psu->smb;
+
+    // 1. 先切换CRPS通路
+    int ret = sensor_crps_begin(drv->psu, SMBUS_PRIO_NORMAL);
+    ASSERT_FR(ret == 0, -1, "switch to CRPS failed!");
+
+    // 2. 读取序列号，序列号已缓存时不再读型号
+    // 获取失败默认设置为PSU_UNKNOWN_MODEL， 后面做进一步处理
+    ret = psu_fru_refresh(smb, slave, PSU_FRU_SLOT(drv->psu_bus, slave), fru);
+    sensor_crps_end(drv->psu, ret < 0 && ret != -ENODATA);
+    if (ret < 0)
+        HAL_DBG("get PSU%u model failed, set to %s", idx + 1, PSU_UNKNOWN_MODEL);
+
+    return 0;
+}
+
+static int sensor_get_psu_max_watts(const char *model, int out)
+{
+#ifdef xtest
+    return 1;
+#endif
+    const psu_cap_t *cap = psu_cap_lookup(model);
+    if (!cap)
+        return -1;
+
+    return out ? cap->out_max_watts : cap->in_max_watts;
+}
+
+// 获取电源对应的状态传感器
+static const sensor_object_t *sensor_psu_status_obj(sensor_drv_t *drv, uint32_t idx)
+{
+    for (size_t i = 0; i < drv->plat->obj_num; i++) {
+        const sensor_object_t *obj = drv->plat->objs + i;
+        if (obj->type == HAL_SEN_DISCRETE && obj->psu == (int)idx)
+            return obj;
+    }
+    return NULL;
+}
+
+// 根据PSU型号修改功率范围信息
+static int sensor_psu_apply_limits(sensor_drv_t *drv, uint32_t idx)
+{
+    for (size_t i = 0; i < drv->plat->obj_num; i++) {
+        const sensor_object_t *obj = drv->plat->objs + i;
+        if (obj->type != HAL_SEN_WATTS || obj->psu != (int)idx)
+            continue;
+
+        const char *model = drv->psus[idx].fru.model;
+        int ret = sensor_get_psu_max_watts(model, obj->offset_l == CRPS_POUT_REG);
+        ASSERT_FR(ret > 0, -1, "get psu%u(%s) max watts fail!", idx + 1, model);
+        drv->max[i] = ret;
+    }
+    return 0;
+}
+
+// 型号未知时使用其它电源识别到的型号
+static void sensor_psu_borrow_model(sensor_drv_t *drv, uint32_t idx)
+{
+    char *model = drv->psus[idx].fru.model;
+    if (strcmp(model, PSU_UNKNOWN_MODEL))
+        return;
+
+    for (uint32_t i = 0; i < drv->psu->psu_num; i++) {
+        const char *known = drv->psus[i].fru.model;
+        if (i != idx && strcmp(known, PSU_UNKNOWN_MODEL)) {
+            strcpy(model, known);
+            return;
+        }
+    }
+}
+
+// 在CRPS通路后面探测读取计划，idx 小于0时探测所有电源
+static int sensor_crps_discover(sensor_drv_t *drv, int idx)
+{
+    psu_object_t *psu = drv->psu;
+    int ret = sensor_crps_begin(psu, SMBUS_PRIO_NORMAL);
+    ASSERT_FR(ret == 0, -1, "switch to CRPS failed!");
+
+    ret = idx < 0 ? psu_pmbus_discover(psu, drv->psu_dev) : psu_pmbus_rediscover(psu, idx, drv->psu_dev);
+    sensor_crps_end(psu, 0);
+    return ret;
+}
+
+// psu_status 发现电源插入时调用，只重新识别这一个电源，其它时候不读电源字符串
+// 可能由扫描(持有 lock)或 sensor_psu 的调用者(不持有 lock)触发，读到的型号先暂存，由下一次扫描发布
+static int sensor_crps_redetect(psu_object_t *psu, uint32_t idx)
+{
+    sensor_drv_t *drv = psu->priv;
+    psu_fru_t fru;
+
+    sensor_get_psu_model(drv, idx, psu->slot[idx].reg.slave, &fru);
+    // 换上的可能是另一个型号，累加器和系数要重新探测
+    if (sensor_crps_discover(drv, idx) < 0)
+        HAL_DBG("psu%u rediscover fail, energy integrated by software", idx + 1);
+    pthread_mutex_lock(&drv->stage_lock);
+    drv->psus[idx].fru_new = fru;
+    __atomic_store_n(&drv->psus[idx].fru_pending, 1, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&drv->stage_lock);
+    return 0;
+}
+
+// 持有 lock 发布 redetect 暂存的型号，借用型号和功率上限依赖其它电源，在这里一起计算
+static void sensor_psu_publish(sensor_drv_t *drv)
+{
+    for (uint32_t idx = 0; idx < drv->psu->psu_num; idx++) {
+        sensor_psu_t *ps = &drv->psus[idx];
+        if (!__atomic_load_n(&ps->fru_pending, __ATOMIC_ACQUIRE))
+            continue;
+        pthread_mutex_lock(&drv->stage_lock);
+        ps->fru = ps->fru_new;
+        ps->fru_pending = 0;
+        pthread_mutex_unlock(&drv->stage_lock);
+        sensor_psu_borrow_model(drv, idx);
+        sensor_psu_apply_limits(drv, idx);
+    }
+}
+
+static int sensor_get_psu_status(psu_object_t *psu, uint32_t idx)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    uint16_t val = 0;
+    // 1、先切换到CRPS通路，状态查询优先于其它请求
+    int ret = sensor_crps_begin(psu, SMBUS_PRIO_URGENT);
+    ASSERT_FR(ret == 0, -1, "switch to CRPS failed!");
+
+    // 2、获取状态
+    ret = psu_read_word(psu, psu->slot[idx].reg.slave, psu->slot[idx].reg.addr, &val);
+    sensor_crps_end(psu, ret != 0);
+    if (ret != 0) {
+        HAL_DBG("Smbus read power status fail, setting psu offline");
+        return HAL_PSU_STAT_OFF;
+    }
+
+    // 3、通过POWER_GOOD# bit位确认是否在位，0表示在位，1表示不在位
+    return (HAL_BIT(11) & val) ? HAL_PSU_STAT_OFF : HAL_PSU_STAT_ON;
+}
+
+static int sensor_get_psu_watts(psu_object_t *psu, uint32_t idx, const sensor_object_t *obj)
+{
+    uint16_t val = 0;
+    // 1、先切换到CRPS通路
+    int ret = sensor_crps_begin(psu, SMBUS_PRIO_NORMAL);
+    ASSERT_FR(ret == 0, -1, "switch to CRPS failed!");
+
+    // 2、获取功率
+    ret = psu_read_word(psu, psu->slot[idx].reg.slave, obj->offset_l, &val);
+    sensor_crps_end(psu, ret != 0);
+    ASSERT_FR(!ret, -1, "Smbus read power watts fail!");
+
+    return val;
+}
+
+static double sensor_crps_power(psu_object_t *psu, uint32_t idx, uint8_t reg)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    uint16_t val = 0;
+
+    int ret = sensor_crps_begin(psu, SMBUS_PRIO_NORMAL);
+    ASSERT_FR(ret == 0, -1, "switch to CRPS failed!");
+
+    ret = psu_read_word(psu, psu->slot[idx].reg.slave, reg, &val);
+    sensor_crps_end(psu, ret != 0);
+    ASSERT_FR(!ret, -1, "Smbus read power watts fail!");
+
+    return psu_lineal_value(val);
+}
+
+static double sensor_crps_pin(psu_object_t *psu, uint32_t idx)
+{
+    return sensor_crps_power(psu, idx, CRPS_PIN_REG);
+}
+
+static double sensor_crps_pout(psu_object_t *psu, uint32_t idx)
+{
+    return sensor_crps_power(psu, idx, CRPS_POUT_REG);
+}
+
+// 只有探测确认了累加器和系数时才读硬件，否则返回失败由 psu_energy_* 按功率软件积分
+static int sensor_crps_energy(psu_object_t *psu, uint32_t idx, int out, psu_energy_t *e)
+{
+    ASSERT_FR(psu && psu->smb && idx < psu->psu_num, -OS_EINVAL, "Invalid argument");
+    const psu_plan_t *plan = &psu->slot[idx].plan[out ? PSU_METRIC_EOUT : PSU_METRIC_EIN];
+    if ((plan->cap != PSU_CAP_ASSUMED && plan->cap != PSU_CAP_YES) || !plan->coef.m)
+        return -ENOTSUP;
+
+    int ret = sensor_crps_begin(psu, SMBUS_PRIO_NORMAL);
+    ASSERT_FR(ret == 0, -1, "switch to CRPS failed!");
+
+    ret = psu_pmbus_energy(psu, psu->slot[idx].reg.slave, plan->cmd, e);
+    sensor_crps_end(psu, ret != 0);
+    return ret;
+}
+
+static int sensor_crps_ara(psu_object_t *psu)
+{
+    // 电源在CRPS通路后面，先切通路再读ARA
+    int ret = sensor_crps_begin(psu, SMBUS_PRIO_URGENT);
+    ASSERT_FR(ret == 0, -1, "switch to CRPS failed!");
+
+    // 没有电源告警时ARA本来就不应答，不当作通路失败
+    ret = psu_smbus_ara(psu);
+    sensor_crps_end(psu, 0);
+    return ret;
+}
+
+// 每个电源读一次状态，只读在位电源的功率，事务数随电源个数线性增长，整次扫描只切一次通路
+// 功率依赖电源状态，选中功率时同时读取所属电源的状态
+static void sensor_sweep_psu(sensor_drv_t *drv, sensor_mask_t mask)
+{
+    const sensor_platform_t *plat = drv->plat;
+    psu_object_t *psu = drv->psu;
+    uint32_t need = 0;
+
+    for (size_t i = 0; i < plat->obj_num; i++) {
+        if ((mask & HAL_BIT(i)) && plat->objs[i].psu >= 0)
+            need |= HAL_BIT(plat->objs[i].psu);
+    }
+
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++) {
+        drv->psus[idx].status_ok = 0;
+        drv->psus[idx].stale = 0;
+        if (!(need & HAL_BIT(idx)))
+            continue;
+        if (sensor_sweep_expired(drv)) {
+            drv->psus[idx].stale = 1;
+            continue;
+        }
+        // 开启告警模式后，两次告警之间返回缓存的状态
+        drv->psus[idx].ts[0] = sensor_now_ns();
+        int pst = psu_status(psu, idx);
+        drv->psus[idx].ts[1] = sensor_now_ns();
+        // 超时时 psu_deadline_end 已经清空通路缓存，退避中没有访问总线
+        if (pst == -ETIMEDOUT)
+            drv->psus[idx].stale = 1;
+        drv->psus[idx].status_ok = pst >= 0;
+        if (pst >= 0) {
+            drv->psus[idx].status = pst;
+            drv->psus[idx].status_valid = 1;
+        }
+    }
+    // 本次或之前读状态时发现的插入，在读功率和取上限之前生效
+    sensor_psu_publish(drv);
+
+    for (size_t i = 0; i < plat->obj_num; i++) {
+        const sensor_object_t *obj = plat->objs + i;
+        if (obj->type != HAL_SEN_WATTS || obj->psu < 0)
+            continue;
+
+        sensor_psu_t *ps = &drv->psus[obj->psu];
+        drv->obj_ok[i] = 0;
+        drv->obj_stale[i] = 0;
+        if (!(mask & HAL_BIT(i)) || !ps->status_ok || ps->status != HAL_PSU_STAT_ON)
+            continue;
+
+        uint64_t start;
+        if (sensor_sweep_expired(drv) || psu_deadline_begin(psu, obj->psu, &start)) {
+            drv->obj_stale[i] = 1;
+            continue;
+        }
+        drv->obj_ts[i][0] = start;
+        int ret = sensor_get_psu_watts(psu, obj->psu, obj);
+        drv->obj_ts[i][1] = sensor_now_ns();
+        if (psu_deadline_end(psu, obj->psu, start)) {
+            drv->obj_stale[i] = 1;
+            continue;
+        }
+        if (ret < 0)
+            continue;
+        drv->raw[i] = ret;
+        drv->obj_ok[i] = 1;
+    }
+}
+
+static void sensor_sweep(sensor_drv_t *drv, sensor_mask_t mask)
+{
+    drv->seq++;
+    drv->sweep_ns = sensor_now_ns();
+    drv->sweep_end_ns = drv->sweep_ns + (uint64_t)drv->dl_cfg.sweep_ms * 1000000ull;
+    pthread_mutex_lock(&drv->snap_lock);
+    drv->flight_mask = mask;
+    drv->flight_seq = drv->seq;
+    pthread_mutex_unlock(&drv->snap_lock);
+    sensor_sweep_bursts(drv, mask);
+    sensor_sweep_psu(drv, mask);
+}
+
+// 从本次扫描的缓存中解出传感器的值
+static void sensor_sample(sensor_drv_t *drv, size_t num, sensor_sample_t *s)
+{
+    const sensor_object_t *obj = drv->plat->objs + num;
+    const sensor_psu_t *ps = obj->psu >= 0 ? &drv->psus[obj->psu] : NULL;
+
+    s->value = 0.0;
+    s->max = drv->max[num];
+    s->state = -1;
+    s->ok = 1;
+    s->stale = 0;
+
+    // 记录产生该读数的事务时间，功率没读(电源不在位)时用状态的读取时间
+    const uint64_t *ts = drv->burst_ts[obj->burst];
+    if (obj->type == HAL_SEN_WATTS && drv->obj_ok[num])
+        ts = drv->obj_ts[num];
+    else if ((obj->type == HAL_SEN_WATTS || obj->type == HAL_SEN_DISCRETE) && ps)
+        ts = ps->ts;
+    s->stamp.seq = drv->seq;
+    s->stamp.sweep_ns = drv->sweep_ns;
+    s->stamp.start_ns = ts[0];
+    s->stamp.end_ns = ts[1];
+
+    // 超过截止时间没有读取的传感器，快照中保留之前的读数
+    if (obj->type == HAL_SEN_DISCRETE)
+        s->stale = ps && ps->stale;
+    else if (obj->type == HAL_SEN_WATTS)
+        s->stale = ps && (ps->stale || drv->obj_stale[num]);
+    else
+        s->stale = drv->burst_stale[obj->burst];
+    if (s->stale) {
+        s->ok = 0;
+        return;
+    }
+
+    switch (obj->type) {
+    case HAL_SEN_TEMP:
+        s->ok = drv->burst_ok[obj->burst];
+        s->value = sensor_get_temp(drv, obj);
+        break;
+    case HAL_SEN_FAN:
+    case HAL_SEN_VOL:
+        s->ok = drv->burst_ok[obj->burst];
+        s->value = sensor_get_vol_fan(drv, obj);
+        break;
+    case HAL_SEN_DISCRETE:
+        // 获取电源状态
+        s->ok = ps && ps->status_ok;
+        if (!s->ok) {
+            HAL_ERR("Smbus read psu staus fail!");
+            break;
+        }
+        s->state = ps->status;
+        break;
+    case HAL_SEN_WATTS:
+        if (ps && ps->status_ok && ps->status == HAL_PSU_STAT_ON) {
+            s->ok = drv->obj_ok[num];
+            if (!s->ok) {
+                HAL_ERR("Smbus read psu watts fail!");
+                break;
+            }
+            s->value = psu_lineal_value(drv->raw[num]);
+        }
+        break;
+    default:
+        HAL_ERR("error object type");
+    }
+}
+
+// 电源状态和功率读取失败时不上报
+static inline int sensor_reportable(sensor_drv_t *drv, size_t num, const sensor_sample_t *s)
+{
+    const sensor_object_t *obj = drv->plat->objs + num;
+    return s->ok || (obj->type != HAL_SEN_DISCRETE && obj->type != HAL_SEN_WATTS);
+}
+
+static int sensor_info(sensor_drv_t *drv, size_t num, const sensor_sample_t *s, hal_data_t *data)
+{
+    const sensor_object_t *obj = drv->plat->objs + num;
+
+    if (!sensor_reportable(drv, num, s))
+        return -1;
+
+    if (obj->type == HAL_SEN_DISCRETE)
+        hal_sensor_data(data, obj->id, obj->type, 0, 0, 0, hal_psu_stat(s->state));
+    else
+        hal_sensor_data(data, obj->id, obj->type, obj->min, s->max, s->value, NULL);
+    return 0;
+}
+
+// 根据上下限和回差计算本次读数对应的告警级别
+static int sensor_alarm_level(sensor_drv_t *drv, size_t num, const sensor_sample_t *s)
+{
+    const sensor_object_t *obj = drv->plat->objs + num;
+    double min = obj->min, max = drv->max[num];
+    double hyst = obj->type < SENSOR_TYPE_MAX ? drv->alarm_cfg.hysteresis[obj->type] : 0;
+
+    // 已经告警时需要回到阈值以内超过回差才算恢复，避免在阈值附近抖动
+    switch (drv->alarm[num].level) {
+    case SENSOR_ALARM_HIGH:
+        max -= hyst;
+        break;
+    case SENSOR_ALARM_LOW:
+        min += hyst;
+        break;
+    }
+
+    if (s->value > max)
+        return SENSOR_ALARM_HIGH;
+    if (s->value < min)
+        return SENSOR_ALARM_LOW;
+    return SENSOR_ALARM_NONE;
+}
+
+// 在采样路径上检查阈值，只在告警产生/恢复时把事件暂存到 b，解锁后再回调
+static void sensor_alarm_eval(sensor_drv_t *drv, size_t num, const sensor_sample_t *s, sensor_batch_t *b)
+{
+    const sensor_object_t *obj = drv->plat->objs + num;
+    sensor_alarm_t *alarm = &drv->alarm[num];
+
+    // 电源状态没有阈值，读取失败时保持原来的告警
+    if (!drv->alarm_cfg.cb || obj->type == HAL_SEN_DISCRETE || !s->ok)
+        return;
+
+    int level = sensor_alarm_level(drv, num, s);
+    if (level == alarm->level) {
+        alarm->count = 0;
+        return;
+    }
+
+    // 连续 debounce 次出现同一个新级别才确认
+    if (level != alarm->pending) {
+        alarm->pending = level;
+        alarm->count = 0;
+    }
+    if (++alarm->count < (drv->alarm_cfg.debounce ?: 1))
+        return;
+
+    b->ev[b->ev_num++] = (sensor_alarm_event_t) {
+        .id = obj->id,
+        .type = obj->type,
+        .level = level,
+        .prev = alarm->level,
+        .value = s->value,
+        .min = obj->min,
+        .max = drv->max[num],
+    };
+    alarm->level = level;
+    alarm->count = 0;
+}
+
+static uint64_t sensor_now_ms(void)
+{
+    return sensor_now_ns() / 1000000;
+}
+
+// 增量上报: 值超出死区、状态变化或心跳到期时才上报
+static int sensor_delta_changed(sensor_drv_t *drv, size_t num, const sensor_sample_t *s, uint64_t now)
+{
+    const sensor_object_t *obj = drv->plat->objs + num;
+    const sensor_last_t *last = &drv->last[num];
+
+    if (!last->valid || last->ok != s->ok || last->state != s->state || last->max != drv->max[num])
+        return 1;
+    if (drv->delta_cfg.heartbeat_ms && now - last->ts_ms >= drv->delta_cfg.heartbeat_ms)
+        return 1;
+
+    double band = obj->type < SENSOR_TYPE_MAX ? drv->delta_cfg.deadband[obj->type] : 0;
+    double diff = s->value - last->value;
+    return (diff < 0 ? -diff : diff) > band;
+}
+
+static void sensor_delta_update(sensor_drv_t *drv, size_t num, const sensor_sample_t *s, uint64_t now)
+{
+    sensor_last_t *last = &drv->last[num];
+
+    last->value = s->value;
+    last->max = drv->max[num];
+    last->state = s->state;
+    last->ok = s->ok;
+    last->valid = 1;
+    last->ts_ms = now;
+}
+
+// 根据筛选条件计算选中的传感器
+static sensor_mask_t sensor_select(const sensor_platform_t *plat, const sensor_filter_t *filter)
+{
+    sensor_mask_t all = plat->obj_num >= 32 ? ~0u : HAL_BIT(plat->obj_num) - 1;
+    if (!filter || (!filter->types && !filter->id_num))
+        return all;
+
+    sensor_mask_t mask = 0;
+    for (size_t i = 0; i < plat->obj_num; i++) {
+        const sensor_object_t *obj = plat->objs + i;
+        if (filter->types & HAL_BIT(obj->type)) {
+            mask |= HAL_BIT(i);
+            continue;
+        }
+        for (size_t j = 0; j < filter->id_num; j++) {
+            if (filter->ids[j] == obj->id) {
+                mask |= HAL_BIT(i);
+                break;
+            }
+        }
+    }
+    return mask;
+}
+
+static void sensor_snap_stage(sensor_drv_t *drv, size_t num, const sensor_sample_t *s)
+{
+    sensor_reading_t *r = &drv->stage[num];
+    r->max = s->max;
+    r->stale = s->stale;
+    if (s->stale) {
+        r->ok = 0;
+        return;
+    }
+    r->ok = s->ok;
+    r->state = s->state;
+    r->value = s->value;
+    r->stamp = s->stamp;
+}
+
+// 扫描结束后发布本次读到的传感器和原始结果 s，唤醒所有等待者
+static void sensor_snap_publish(sensor_drv_t *drv, sensor_mask_t done, const sensor_sample_t *s)
+{
+    pthread_mutex_lock(&drv->snap_lock);
+    for (size_t i = 0; i < drv->plat->obj_num; i++) {
+        if (!(done & HAL_BIT(i)))
+            continue;
+        drv->snap.r[i] = drv->stage[i];
+        drv->pub[i] = s[i];
+    }
+    drv->pub_mask = done;
+    drv->snap.seq = drv->seq;
+    drv->flight_mask = 0;
+    pthread_cond_broadcast(&drv->snap_cond);
+    pthread_mutex_unlock(&drv->snap_lock);
+}
+
+// 持有 lock 扫描并暂存 mask 中的读数和告警，然后发布快照
+// 增量上报时只把需要上报的传感器放进 b->report，并同时更新上报历史
+static void sensor_batch_sweep(sensor_drv_t *drv, sensor_mask_t mask, int delta, sensor_batch_t *b)
+{
+    uint64_t now = delta ? sensor_now_ms() : 0;
+
+    b->report = 0;
+    b->ev_num = 0;
+    b->alarm_cb = drv->alarm_cfg.cb;
+    b->alarm_priv = drv->alarm_cfg.priv;
+    sensor_sweep(drv, mask);
+    for (size_t i = 0; i < drv->plat->obj_num; ++i) {
+        if (!(mask & HAL_BIT(i)))
+            continue;
+
+        sensor_sample_t *s = &b->s[i];
+        sensor_sample(drv, i, s);
+        sensor_snap_stage(drv, i, s);
+        sensor_alarm_eval(drv, i, s, b);
+        if (!sensor_reportable(drv, i, s) || (delta && !sensor_delta_changed(drv, i, s, now)))
+            continue;
+        if (delta)
+            sensor_delta_update(drv, i, s, now);
+        b->report |= HAL_BIT(i);
+    }
+    sensor_snap_publish(drv, mask, b->s);
+}
+
+// 不持有任何锁，先回调告警事件，再逐个上报读数；回调失败后不再上报，b->report 中留下没有上报的传感器
+static int sensor_batch_deliver(sensor_drv_t *drv, sensor_batch_t *b, hal_data_t *data,
+                                hal_iter_sensor_t cb, sensor_stamp_cb_t scb, void *priv)
+{
+    for (size_t i = 0; i < b->ev_num; i++)
+        b->alarm_cb(&b->ev[i], b->alarm_priv);
+
+    int ret = 0;
+    for (size_t i = 0; i < drv->plat->obj_num && b->report && ret == 0; ++i) {
+        if (!(b->report & HAL_BIT(i)))
+            continue;
+        b->report &= ~HAL_BIT(i);
+        sensor_info(drv, i, &b->s[i], data);
+        ret = scb ? scb(data, &b->s[i].stamp, priv) : cb(data, priv);
+    }
+    return ret;
+}
+
+// 从池中取一个上报对象，同时遍历的调用者超过池的大小时才临时分配
+static hal_data_t *sensor_data_get(sensor_drv_t *drv)
+{
+    uint32_t busy = __atomic_load_n(&drv->data_busy, __ATOMIC_RELAXED);
+    for (int i = 0; i < SENSOR_DATA_POOL; i++) {
+        if (busy & HAL_BIT(i))
+            continue;
+        busy = __atomic_fetch_or(&drv->data_busy, HAL_BIT(i), __ATOMIC_ACQUIRE);
+        if (!(busy & HAL_BIT(i)))
+            return drv->data_pool[i];
+    }
+    return hal_data_alloc();
+}
+
+static void sensor_data_put(sensor_drv_t *drv, hal_data_t *data)
+{
+    for (int i = 0; i < SENSOR_DATA_POOL; i++) {
+        if (drv->data_pool[i] == data) {
+            __atomic_fetch_and(&drv->data_busy, ~HAL_BIT(i), __ATOMIC_RELEASE);
+            return;
+        }
+    }
+    data->free(data);
+}
+
+// 覆盖 mask 的扫描正在进行时等它发布，再原样上报它的扫描结果(包括过期和失败)，不再访问总线
+// 告警事件只由扫描者回调一次；返回0表示没有可以共用的扫描，需要自己扫描；*ret 为回调的返回值
+static int sensor_iter_follow(sensor_drv_t *drv, sensor_mask_t mask,
+                              hal_iter_sensor_t cb, sensor_stamp_cb_t scb, void *priv, int *ret)
+{
+    sensor_batch_t b;
+
+    pthread_mutex_lock(&drv->snap_lock);
+    if (!drv->flight_mask || (drv->flight_mask & mask) != mask) {
+        pthread_mutex_unlock(&drv->snap_lock);
+        return 0;
+    }
+    uint64_t seq = drv->flight_seq;
+    while (drv->snap.seq < seq)
+        pthread_cond_wait(&drv->snap_cond, &drv->snap_lock);
+    // 等待期间又有别的扫描发布且没有覆盖 mask 时自己扫描
+    if ((drv->pub_mask & mask) != mask) {
+        pthread_mutex_unlock(&drv->snap_lock);
+        return 0;
+    }
+    memcpy(b.s, drv->pub, drv->plat->obj_num * sizeof(b.s[0]));
+    pthread_mutex_unlock(&drv->snap_lock);
+
+    b.report = 0;
+    b.ev_num = 0;
+    for (size_t i = 0; i < drv->plat->obj_num; ++i) {
+        if ((mask & HAL_BIT(i)) && sensor_reportable(drv, i, &b.s[i]))
+            b.report |= HAL_BIT(i);
+    }
+
+    *ret = -1;
+    hal_data_t *data = sensor_data_get(drv);
+    ASSERT_FR(data, 1, "malloc fail!");
+
+    *ret = sensor_batch_deliver(drv, &b, data, cb, scb, priv);
+    sensor_data_put(drv, data);
+    return 1;
+}
+
+// cb 和 scb 二选一，scb 额外带上读数的时间戳
+static int sensor_iter_mask(sensor_drv_t *drv, sensor_mask_t mask, int delta,
+                            hal_iter_sensor_t cb, sensor_stamp_cb_t scb, void *priv)
+{
+    int ret = 0;
+    // 增量上报依赖自己的上次上报记录，不和其它扫描共用
+    if (!delta && sensor_iter_follow(drv, mask, cb, scb, priv, &ret))
+        return ret;
+
+    hal_data_t *data = sensor_data_get(drv);
+    ASSERT_FR(data, -1, "malloc fail!");
+
+    // 回调不持有 lock，回调中再遍历或重新配置不会死锁，也不会拖住其它扫描
+    sensor_batch_t b;
+    pthread_mutex_lock(&drv->lock);
+    sensor_batch_sweep(drv, mask, delta, &b);
+    pthread_mutex_unlock(&drv->lock);
+
+    ret = sensor_batch_deliver(drv, &b, data, cb, scb, priv);
+    sensor_data_put(drv, data);
+
+    // 回调失败后没有上报的传感器清除上报历史，下一次增量遍历重新上报
+    if (delta && b.report) {
+        pthread_mutex_lock(&drv->lock);
+        for (size_t i = 0; i < drv->plat->obj_num; ++i) {
+            if (b.report & HAL_BIT(i))
+                drv->last[i].valid = 0;
+        }
+        pthread_mutex_unlock(&drv->lock);
+    }
+    return ret;
+}
+
+static int sensor_iter(hal_device_sensor_t *dev, hal_iter_sensor_t cb, void *priv)
+{
+    ASSERT_FR(dev && dev->priv && cb, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+    return sensor_iter_mask(drv, sensor_select(drv->plat, NULL), 0, cb, NULL, priv);
+}
+
+HAL_API int sensor_iter_filter(hal_device_sensor_t *dev, const sensor_filter_t *filter,
+                               hal_iter_sensor_t cb, void *priv)
+{
+    ASSERT_FR(dev && dev->priv && cb, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    sensor_mask_t mask = sensor_select(drv->plat, filter);
+    if (!mask)
+        return 0;
+    return sensor_iter_mask(drv, mask, 0, cb, NULL, priv);
+}
+
+HAL_API int sensor_iter_stamped(hal_device_sensor_t *dev, const sensor_filter_t *filter,
+                                sensor_stamp_cb_t cb, void *priv)
+{
+    ASSERT_FR(dev && dev->priv && cb, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    sensor_mask_t mask = sensor_select(drv->plat, filter);
+    if (!mask)
+        return 0;
+    return sensor_iter_mask(drv, mask, 0, NULL, cb, priv);
+}
+
+HAL_API int sensor_delta_config(hal_device_sensor_t *dev, const sensor_delta_cfg_t *cfg)
+{
+    ASSERT_FR(dev && dev->priv, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    if (cfg) {
+        for (int i = 0; i < SENSOR_TYPE_MAX; i++)
+            ASSERT_FR(cfg->deadband[i] >= 0, -OS_EINVAL, "Invalid deadband");
+    }
+
+    // 增量遍历持有 lock 读取死区和上报历史
+    pthread_mutex_lock(&drv->lock);
+    if (cfg)
+        drv->delta_cfg = *cfg;
+    // 清空历史，下一次增量遍历全部上报
+    memset(drv->last, 0, sizeof(drv->last));
+    pthread_mutex_unlock(&drv->lock);
+    return 0;
+}
+
+HAL_API int sensor_alarm_config(hal_device_sensor_t *dev, const sensor_alarm_cfg_t *cfg)
+{
+    ASSERT_FR(dev && dev->priv, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    if (cfg) {
+        for (int i = 0; i < SENSOR_TYPE_MAX; i++)
+            ASSERT_FR(cfg->hysteresis[i] >= 0, -OS_EINVAL, "Invalid hysteresis");
+    }
+
+    // 扫描持有 lock 检查告警，重新配置不能和它交错
+    pthread_mutex_lock(&drv->lock);
+    memset(&drv->alarm_cfg, 0, sizeof(drv->alarm_cfg));
+    memset(drv->alarm, 0, sizeof(drv->alarm));
+    if (cfg)
+        drv->alarm_cfg = *cfg;
+    pthread_mutex_unlock(&drv->lock);
+    return 0;
+}
+
+HAL_API int sensor_alarm_check(hal_device_sensor_t *dev, const sensor_filter_t *filter)
+{
+    ASSERT_FR(dev && dev->priv, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    sensor_mask_t mask = sensor_select(drv->plat, filter);
+    sensor_batch_t b;
+    pthread_mutex_lock(&drv->lock);
+    if (!drv->alarm_cfg.cb) {
+        pthread_mutex_unlock(&drv->lock);
+        HAL_ERR("alarm not configured");
+        return -OS_EINVAL;
+    }
+    sensor_batch_sweep(drv, mask, 0, &b);
+    pthread_mutex_unlock(&drv->lock);
+
+    // 只回调告警，不上报读数
+    b.report = 0;
+    sensor_batch_deliver(drv, &b, NULL, NULL, NULL, NULL);
+    return 0;
+}
+
+HAL_API int sensor_iter_delta(hal_device_sensor_t *dev, const sensor_filter_t *filter,
+                              hal_iter_sensor_t cb, void *priv)
+{
+    ASSERT_FR(dev && dev->priv && cb, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    sensor_mask_t mask = sensor_select(drv->plat, filter);
+    if (!mask)
+        return 0;
+    return sensor_iter_mask(drv, mask, 1, cb, NULL, priv);
+}
+
+HAL_API int sensor_deadline_config(hal_device_sensor_t *dev, const sensor_deadline_cfg_t *cfg)
+{
+    ASSERT_FR(dev && dev->priv, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    pthread_mutex_lock(&drv->lock);
+    memset(&drv->dl_cfg, 0, sizeof(drv->dl_cfg));
+    if (cfg)
+        drv->dl_cfg = *cfg;
+    memset(drv->burst_hold, 0, sizeof(drv->burst_hold));
+    psu_deadline_set(drv->psu, drv->dl_cfg.xfer_ms, drv->dl_cfg.backoff_ms);
+    pthread_mutex_unlock(&drv->lock);
+    return 0;
+}
+
+HAL_API int sensor_snapshot(hal_device_sensor_t *dev, sensor_snapshot_t *snap)
+{
+    ASSERT_FR(dev && dev->priv && snap, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    pthread_mutex_lock(&drv->snap_lock);
+    *snap = drv->snap;
+    pthread_mutex_unlock(&drv->snap_lock);
+    return 0;
+}
+
+HAL_API int sensor_wait_newer(hal_device_sensor_t *dev, uint64_t seq, int timeout_ms, sensor_snapshot_t *snap)
+{
+    ASSERT_FR(dev && dev->priv && snap, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    struct timespec ts;
+    if (timeout_ms >= 0) {
+        uint64_t deadline = sensor_now_ns() + (uint64_t)timeout_ms * 1000000ull;
+        ts.tv_sec = deadline / 1000000000ull;
+        ts.tv_nsec = deadline % 1000000000ull;
+    }
+
+    int ret = 0;
+    pthread_mutex_lock(&drv->snap_lock);
+    while (drv->snap.seq <= seq && ret == 0) {
+        if (timeout_ms < 0)
+            ret = pthread_cond_wait(&drv->snap_cond, &drv->snap_lock);
+        else
+            ret = pthread_cond_timedwait(&drv->snap_cond, &drv->snap_lock, &ts);
+    }
+    if (drv->snap.seq > seq) {
+        *snap = drv->snap;
+        ret = 0;
+    }
+    pthread_mutex_unlock(&drv->snap_lock);
+    return ret ? -ret : 0;
+}
+
+HAL_API psu_object_t *sensor_psu(hal_device_sensor_t *dev)
+{
+    ASSERT_FR(dev && dev->priv, NULL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+    return drv->psu;
+}
+
+HAL_API int sensor_psu_alert_enable(hal_device_sensor_t *dev, int alert_fd)
+{
+    ASSERT_FR(dev && dev->priv, -OS_EINVAL, "Invalid argument");
+    sensor_drv_t *drv = dev->priv;
+
+    ASSERT_FR(drv->psu, -OS_EINVAL, "psu not initialized");
+
+    return psu_alert_enable(drv->psu, alert_fd, drv->psu_dev);
+}
+
+static void sensor_drv_free(sensor_drv_t *drv)
+{
+    for (int i = 0; i < SENSOR_DATA_POOL; i++) {
+        if (drv->data_pool[i])
+            drv->data_pool[i]->free(drv->data_pool[i]);
+    }
+    if (drv->mcu)
+        hal_proto_free(drv->mcu);
+    if (drv->mcu_fan)
+        hal_proto_free(drv->mcu_fan);
+
+    if (drv->smb)
+        drv->smb->free(drv->smb);
+
+    if (drv->smb_fan)
+        drv->smb_fan->free(drv->smb_fan);
+
+    smbus_sched_put(drv->sched);
+    smbus_sched_put(drv->sched_fan);
+    smbus_arb_close(drv->arb);
+    smbus_arb_close(drv->arb_fan);
+
+    psu_free(drv->psu);
+    pthread_mutex_destroy(&drv->lock);
+    pthread_mutex_destroy(&drv->stage_lock);
+    pthread_mutex_destroy(&drv->snap_lock);
+    pthread_cond_destroy(&drv->snap_cond);
+    free(drv);
+}
+
+static void sensor_close(struct hal_device_t *dev)
+{
+    sensor_drv_free(dev->priv);
+}
+
+#define SENSOR_PLAT     yudi
+#define SENSOR_PLAT_DEF "sensor_yudi.def"
+#include "sensor_table_gen.h"
+
+// 新增平台只需要增加描述文件，并在这里展开
+static const sensor_platform_t *sensor_platforms[] = {
+    &sensor_yudi_platform,
+};
+
+static hal_sensor_method_t sensor_method = { .iter = sensor_iter };
+// 设备模板，每次打开时复制一份
+static const hal_device_sensor_t sensor_dev = {
+    HACL_DEVICE(HAL_TAG_DEV_SENSOR, NULL, NULL, sensor_close),
+    .method = &sensor_method,
+};
+
+
+static const sensor_platform_t *sensor_platform_find(hal_family_t *family)
+{
+    // 未指定平台时使用第一个平台
+    if (!family || !family->platform || family->platform[0] == '\0')
+        return sensor_platforms[0];
+
+    for (unsigned int i = 0; i < HAL_ARRSZ(sensor_platforms); i++) {
+        if (!strcmp(sensor_platforms[i]->name, family->platform))
+            return sensor_platforms[i];
+    }
+
+    return NULL;
+}
+
+// psu_free 在关闭告警、销毁锁之后调用
+static void sensor_psu_free(psu_object_t *psu)
+{
+    if (psu->smb)
+        psu->smb->free(psu->smb);
+    smbus_sched_put(psu->sched);
+    smbus_arb_close(psu->arb);
+    free(psu);
+}
+
+static int sensor_psu_init(sensor_drv_t *drv)
+{
+    const sensor_platform_t *plat = drv->plat;
+    ASSERT_FR(plat->psu_num <= PSU_NUM_MAX, -1, "too many psu(%zu)!", plat->psu_num);
+    psu_object_t *psu = psu_object_alloc(plat->psu_num);
+    ASSERT_FR(psu, -1, "malloc fail!");
+    psu->free = sensor_psu_free;
+
+    char devname[HAL_NAME_MAX] = { 0 };
+    drv->psu_bus = hal_find_i2c_bus(plat->psu_bus);
+    snprintf(devname, sizeof(devname), "/dev/i2c-%d", drv->psu_bus);
+    const char *i2c_devname = hal_getenv(HAL_ENV_SMBUS_DEV) ?: devname;
+    snprintf(drv->psu_dev, sizeof(drv->psu_dev), "%s", i2c_devname);
+
+    hal_smbus_t *smb = hal_smbus_alloc(i2c_devname, 0, 0);
+    ASSERT_FG(smb, err, "smbus init fail!");
+
+    psu->smb = smb;
+    psu->sched = smbus_sched_get(i2c_devname);
+    // 仲裁器打不开时不缓存通路，每次访问都切一次
+    psu->arb = smbus_arb_open(i2c_devname);
+    if (!psu->arb)
+        HAL_ERR("open psu bus arbiter fail, select CRPS on every access!");
+    psu->type = HAL_PSU_UNKNOW;
+    psu->status = sensor_get_psu_status;
+    psu->ara = sensor_crps_ara;
+    psu->pin = sensor_crps_pin;
+    psu->pout = sensor_crps_pout;
+    psu->energy = sensor_crps_energy;
+    psu->redetect = sensor_crps_redetect;
+    psu->priv = drv;
+    drv->psu = psu;
+
+    // 优先使用上次识别的结果，没有缓存时才读电源
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++) {
+        const sensor_object_t *obj = sensor_psu_status_obj(drv, idx);
+        ASSERT_FG(obj, err, "psu%u not described!", idx + 1);
+        psu->slot[idx].reg.slave = plat->bursts[obj->burst].slave;
+        psu->slot[idx].reg.addr = obj->offset_l;
+        // 电能累加器由 QUERY 确认，不支持或读不到系数时按功率软件积分
+        psu_plan_declare(psu, idx, PSU_METRIC_EIN, PSU_CAP_PROBE, PMBUS_READ_EIN);
+        psu_plan_declare(psu, idx, PSU_METRIC_EOUT, PSU_CAP_PROBE, PMBUS_READ_EOUT);
+        if (psu_fru_load(PSU_FRU_SLOT(drv->psu_bus, psu->slot[idx].reg.slave), &drv->psus[idx].fru) != 0)
+            sensor_get_psu_model(drv, idx, psu->slot[idx].reg.slave, &drv->psus[idx].fru);
+    }
+
+    if (sensor_crps_discover(drv, -1) < 0)
+        HAL_DBG("psu discover fail, energy integrated by software");
+
+    // 将未获取到的电源型号设置为第一个识别到的电源型号
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++)
+        sensor_psu_borrow_model(drv, idx);
+
+    for (uint32_t idx = 0; idx < psu->psu_num; idx++) {
+        int ret = sensor_psu_apply_limits(drv, idx);
+        ASSERT_FG(ret == 0, err, "get psu max watts fail!");
+    }
+
+    return 0;
+err:
+    psu_free(psu);
+    drv->psu = NULL;
+    return -1;
+}
+
+HAL_API hal_device_t *sensor_open(hal_module_t __attribute__((unused)) *hm, 
+                                  hal_family_t *family)
+{
+    HAL_BUG_ON_OPEN(sensor_open);
+
+    const sensor_platform_t *plat = sensor_platform_find(family);
+    ASSERT_FR(plat, NULL, "sensor platform not supported!");
+
+    sensor_drv_t *drv = calloc(1, sizeof(sensor_drv_t));
+    ASSERT_FR(drv, NULL, "malloc fail!");
+    hal_device_sensor_t *dev = &drv->dev;
+    *dev = sensor_dev;
+    drv->plat = plat;
+    pthread_mutex_init(&drv->lock, NULL);
+    pthread_mutex_init(&drv->stage_lock, NULL);
+    pthread_mutex_init(&drv->snap_lock, NULL);
+    // 等待超时按 CLOCK_MONOTONIC 计算
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&drv->snap_cond, &attr);
+    pthread_condattr_destroy(&attr);
+    for (size_t i = 0; i < drv->plat->obj_num; i++)
+        drv->max[i] = drv->plat->objs[i].max;
+
+    drv->snap.num = drv->plat->obj_num;
+    for (size_t i = 0; i < drv->plat->obj_num; i++) {
+        sensor_reading_t *r = &drv->stage[i];
+        r->id = drv->plat->objs[i].id;
+        r->type = drv->plat->objs[i].type;
+        r->min = drv->plat->objs[i].min;
+        r->state = -1;
+        drv->snap.r[i] = *r;
+    }
+
+    // 初始化获取sensor信息的smbus
+    char devname[HAL_NAME_MAX] = { 0 };
+    snprintf(devname, sizeof(devname), "/dev/i2c-%d", hal_find_i2c_bus(drv->plat->sensor_bus));
+
+    const char *i2c_devname = hal_getenv(HAL_ENV_SMBUS_DEV) ?: devname;
+    drv->smb = hal_smbus_alloc(i2c_devname, SENSOR_SLAVE, 0);
+    ASSERT_FG(drv->smb, err, "sensor smbus init fail!");
+    drv->sched = smbus_sched_get(i2c_devname);
+    drv->arb = smbus_arb_open(i2c_devname);
+
+    snprintf(devname, sizeof(devname), "/dev/i2c-%d", hal_find_i2c_bus(drv->plat->fan_bus));
+    drv->smb_fan = hal_smbus_alloc(i2c_devname, SENSOR_SLAVE, 0);
+    ASSERT_FG(drv->smb_fan, err, "sensor smbus init fail!");
+    drv->sched_fan = smbus_sched_get(i2c_devname);
+    drv->arb_fan = smbus_arb_open(i2c_devname);
+
+    // 扫描和遍历用到的对象在这里一次分配好，稳定轮询时不再分配内存
+    drv->mcu = hal_proto_alloc(drv->smb, SENSOR_SLAVE, MCU_PROTO_V1);
+    ASSERT_FG(drv->mcu, err, "MCU proto alloc fail!");
+    drv->mcu_fan = hal_proto_alloc(drv->smb_fan, SENSOR_SLAVE, MCU_PROTO_V1);
+    ASSERT_FG(drv->mcu_fan, err, "fan MCU proto alloc fail!");
+    for (int i = 0; i < SENSOR_DATA_POOL; i++) {
+        drv->data_pool[i] = hal_data_alloc();
+        ASSERT_FG(drv->data_pool[i], err, "malloc fail!");
+    }
+
+    // 初始化获取psu的smbus
+    int ret = sensor_psu_init(drv);
+    ASSERT_FG(ret == 0, err, "psu smbus init fail!");
+
+    dev->priv = drv;
+    return (hal_device_t *)dev;
+err:
+    sensor_drv_free(drv);
+    return NULL;
+}
+
+HAL_DECL_MODULE(sensor) = {
+    HAL_MODULE("sensor", HAL_TAG_MOD_DEVICE, sensor_open, HAL_FLG_MUTEX),
+    .family_cnt = 1,
+    .family = { { "sxf", "yudi", ""} },
+};
+
+
+
@@ -0,0 +1,244 @@
+#ifndef __SXF_SENSOR_H__
+#define __SXF_SENSOR_H__
+
+#include "hal.h"
+#include "hal_sensor.h"
+#include "psu.h"
+
+#define SENSOR_TYPE_MAX     8       // 增量上报可配置死区的传感器类型个数
+#define SENSOR_SNAP_MAX     32      // 快照最多包含的传感器个数，不小于单个平台的传感器个数
+#define SENSOR_DATA_POOL    4       // 预先分配的上报对象个数，同时遍历的调用者不超过它时不分配内存
+
+// 传感器筛选条件，类型和id任意一个匹配即选中，两者都为空时选中全部
+typedef struct {
+    uint32_t types;                     // 类型掩码，HAL_BIT(hal_sensor_type_e)
+    const hal_sensor_id_e *ids;         // 传感器id列表
+    size_t id_num;
+} sensor_filter_t;
+
+// 告警级别
+typedef enum {
+    SENSOR_ALARM_NONE,
+    SENSOR_ALARM_LOW,                   // 低于下限
+    SENSOR_ALARM_HIGH,                  // 高于上限
+} sensor_alarm_level_e;
+
+// 告警产生或恢复时的事件
+typedef struct {
+    hal_sensor_id_e id;
+    hal_sensor_type_e type;
+    uint8_t level;                      // 新的告警级别，SENSOR_ALARM_NONE 表示恢复
+    uint8_t prev;                       // 之前的告警级别
+    double value;                       // 触发本次变化的读数
+    double min;
+    double max;
+} sensor_alarm_event_t;
+
+typedef void (*sensor_alarm_cb_t)(const sensor_alarm_event_t *ev, void *priv);
+
+// 告警配置
+typedef struct {
+    double hysteresis[SENSOR_TYPE_MAX]; // 按 hal_sensor_type_e 配置，回到阈值以内超过回差才恢复
+    uint8_t debounce;                   // 连续多少次读数越限/恢复才确认，0和1表示不去抖
+    sensor_alarm_cb_t cb;               // 告警产生/恢复时的回调
+    void *priv;
+} sensor_alarm_cfg_t;
+
+// 增量上报配置
+typedef struct {
+    double deadband[SENSOR_TYPE_MAX];   // 按 hal_sensor_type_e 配置，与上次上报值相差超过死区才上报
+    uint32_t heartbeat_ms;              // 超过该时间未上报则强制上报一次，0表示不强制
+} sensor_delta_cfg_t;
+
+// 读数的时间戳，均为 CLOCK_MONOTONIC 纳秒
+typedef struct {
+    uint64_t seq;                       // 产生该读数的扫描序号，同一次扫描的读数相同
+    uint64_t tick_ns;                   // 周期采样时本次采样的计划时刻，其它情况为0
+    uint64_t sweep_ns;                  // 本次扫描开始的时间
+    uint64_t start_ns;                  // 读取该传感器的总线事务开始时间
+    uint64_t end_ns;                    // 读取该传感器的总线事务结束时间
+} sensor_stamp_t;
+
+// 截止时间配置，均为0时不限制
+typedef struct {
+    uint32_t sweep_ms;                  // 一次扫描的截止时间，超过后剩余的读取直接标记为过期
+    uint32_t xfer_ms;                   // 单个设备一次读取的截止时间
+    uint32_t backoff_ms;                // 设备读取超时后跳过它的时间，期间它的读数标记为过期
+} sensor_deadline_cfg_t;
+
+typedef int (*sensor_stamp_cb_t)(hal_data_t *data, const sensor_stamp_t *st, void *priv);
+
+// 周期采样配置
+typedef struct {
+    uint32_t period_ms;                 // 采样周期
+    int cpu;                            // 采样线程绑定的cpu，-1表示不绑定
+    int rt_prio;                        // SCHED_FIFO 优先级，0表示使用普通调度
+    sensor_filter_t filter;             // 每次采样的筛选条件，全空表示全部
+} sensor_sampler_cfg_t;
+
+// 周期采样统计
+typedef struct {
+    uint64_t samples;                   // 完成的采样次数
+    uint64_t overruns;                  // 因上一次采样超时错过的周期数
+    uint64_t errors;                    // 采样返回失败的次数
+    uint64_t jitter_max_ns;             // 实际唤醒时刻相对计划时刻的最大延迟
+    uint64_t jitter_sum_ns;             // 累计延迟，除以 samples 得到平均值
+    uint64_t last_ns;                   // 最近一次采样的耗时
+} sensor_sampler_stat_t;
+
+typedef struct sensor_sampler_t sensor_sampler_t;
+
+// 快照中单个传感器最近一次的读数
+typedef struct {
+    hal_sensor_id_e id;
+    hal_sensor_type_e type;
+    uint8_t ok;                         // 最近一次读取是否成功
+    uint8_t stale;                      // 最近一次扫描因超过截止时间没有读到，value/state/stamp 保留之前的读数
+    int state;                          // 电源状态，非电源状态传感器为-1
+    double value;
+    double min;
+    double max;
+    sensor_stamp_t stamp;               // stamp.seq 为0表示还没有读过
+} sensor_reading_t;
+
+// 所有传感器最近一次读数，seq 为最近一次完成的扫描序号
+typedef struct {
+    uint64_t seq;
+    size_t num;
+    sensor_reading_t r[SENSOR_SNAP_MAX];
+} sensor_snapshot_t;
+
+/**
+ * @description: 获取传感器设备上的电源句柄，可配合 psu_energy_input/psu_energy_output 读取电能
+ *               句柄随设备关闭一起释放，调用者不要 psu_free
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @return {psu_object_t*} 成功: psu句柄, 失败: NULL
+ */
+psu_object_t *sensor_psu(hal_device_sensor_t *dev);
+
+/**
+ * @description: 电源状态改为SMBALERT#告警驱动，两次告警之间 sensor_iter 返回缓存的电源状态
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {int} alert_fd: 告警线的gpio事件fd，测试时可以用eventfd代替，由调用者关闭
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_psu_alert_enable(hal_device_sensor_t *dev, int alert_fd);
+
+/**
+ * @description: 只遍历筛选出的传感器，只访问这些传感器所在的区间和电源
+ *               选中电源功率时会同时读取该电源的状态，但只上报选中的传感器
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {const sensor_filter_t*} filter: 筛选条件，NULL 表示全部
+ * @param {hal_iter_sensor_t} cb: 每个传感器的回调，返回非0时停止遍历
+ * @param {void*} priv: 回调的私有数据
+ * @return {int} 成功: 0, 失败: 回调的返回值或 -errno
+ */
+int sensor_iter_filter(hal_device_sensor_t *dev, const sensor_filter_t *filter,
+                       hal_iter_sensor_t cb, void *priv);
+
+/**
+ * @description: 配置增量上报的死区和心跳，并清空上报历史
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {const sensor_delta_cfg_t*} cfg: 增量配置，NULL 表示只清空历史
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_delta_config(hal_device_sensor_t *dev, const sensor_delta_cfg_t *cfg);
+
+/**
+ * @description: 配置告警引擎，之后每次遍历都会按传感器的上下限检查读数，只在告警产生/恢复时回调
+ *               电源功率的上限随电源型号变化，电源状态不参与阈值检查
+ *               告警和遍历的回调都在扫描释放设备锁之后调用，回调中可以再次调用本设备的接口
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {const sensor_alarm_cfg_t*} cfg: 告警配置，NULL 表示关闭告警并清空告警状态
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_alarm_config(hal_device_sensor_t *dev, const sensor_alarm_cfg_t *cfg);
+
+/**
+ * @description: 只采样并检查告警，不上报读数，适合只关心告警的调用者周期调用
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {const sensor_filter_t*} filter: 筛选条件，NULL 表示全部
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_alarm_check(hal_device_sensor_t *dev, const sensor_filter_t *filter);
+
+/**
+ * @description: 增量遍历，只上报值超出死区、状态变化或心跳到期的传感器
+ *               首次遍历和 sensor_delta_config 之后上报全部选中的传感器
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {const sensor_filter_t*} filter: 筛选条件，NULL 表示全部
+ * @param {hal_iter_sensor_t} cb: 每个变化的传感器的回调，返回非0时停止遍历
+ * @param {void*} priv: 回调的私有数据
+ * @return {int} 成功: 0, 失败: 回调的返回值或 -errno
+ */
+int sensor_iter_delta(hal_device_sensor_t *dev, const sensor_filter_t *filter,
+                      hal_iter_sensor_t cb, void *priv);
+
+/**
+ * @description: 与 sensor_iter_filter 相同，回调额外带上每个读数的扫描序号和总线事务起止时间
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {const sensor_filter_t*} filter: 筛选条件，NULL 表示全部
+ * @param {sensor_stamp_cb_t} cb: 每个传感器的回调，返回非0时停止遍历
+ * @param {void*} priv: 回调的私有数据
+ * @return {int} 成功: 0, 失败: 回调的返回值或 -errno
+ */
+int sensor_iter_stamped(hal_device_sensor_t *dev, const sensor_filter_t *filter,
+                        sensor_stamp_cb_t cb, void *priv);
+
+/**
+ * @description: 配置扫描和单个设备读取的截止时间，让卡住总线的设备不拖住整次扫描
+ *               总线事务无法中途取消，一次扫描最长为 sweep_ms 加上一个正在进行的事务；
+ *               超时设备的读数标记为过期，退避期间不再访问，之后的事务重新切换通路
+ *               电源的截止时间同时通过 psu_deadline_set 作用于 psu_status 等接口
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {const sensor_deadline_cfg_t*} cfg: 截止时间，NULL 表示不限制
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_deadline_config(hal_device_sensor_t *dev, const sensor_deadline_cfg_t *cfg);
+
+/**
+ * @description: 获取最近一次扫描后的快照，只复制缓存，不访问总线
+ *               每次 sensor_iter/sensor_alarm_check/周期采样完成一次扫描后更新，只更新该次扫描选中的传感器
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {sensor_snapshot_t*} snap: 输出的快照
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_snapshot(hal_device_sensor_t *dev, sensor_snapshot_t *snap);
+
+/**
+ * @description: 等待序号大于 seq 的扫描完成后返回快照，自己不触发扫描
+ *               每完成一次扫描唤醒所有等待者一次，可以用上次返回的 snap->seq 循环等待
+ * @param {hal_device_sensor_t*} dev: 传感器设备
+ * @param {uint64_t} seq: 已经处理过的扫描序号，0 表示等待第一次扫描
+ * @param {int} timeout_ms: 超时时间，-1表示一直等待
+ * @param {sensor_snapshot_t*} snap: 输出的快照
+ * @return {int} 成功: 0, 超时: -ETIMEDOUT, 失败: -errno
+ */
+int sensor_wait_newer(hal_device_sensor_t *dev, uint64_t seq, int timeout_ms, sensor_snapshot_t *snap);
+
+/**
+ * @description: 启动周期采样线程，按 CLOCK_MONOTONIC 的绝对时刻唤醒，周期不随采样耗时漂移
+ *               采样超过一个周期时跳过错过的周期并计入 overruns，不会连续补采
+ * @param {hal_device_sensor_t*} dev: 传感器设备，需在 sensor_sampler_stop 之后再关闭
+ * @param {const sensor_sampler_cfg_t*} cfg: 采样配置，绑核或实时优先级设置失败时只告警
+ *                                          filter.ids 会被复制，返回后调用者即可释放，个数不超过单个平台的传感器上限
+ * @param {sensor_stamp_cb_t} cb: 每个读数的回调，在采样线程中调用，st->tick_ns 为计划时刻
+ * @param {void*} priv: 回调的私有数据
+ * @return {sensor_sampler_t*} 成功: 采样句柄, 失败: NULL
+ */
+sensor_sampler_t *sensor_sampler_start(hal_device_sensor_t *dev, const sensor_sampler_cfg_t *cfg,
+                                       sensor_stamp_cb_t cb, void *priv);
+/**
+ * @description: 停止采样线程并释放句柄，返回时回调不会再被调用
+ * @param {sensor_sampler_t*} sp: 采样句柄，NULL 时什么也不做
+ */
+void sensor_sampler_stop(sensor_sampler_t *sp);
+/**
+ * @description: 获取采样统计
+ * @param {sensor_sampler_t*} sp: 采样句柄
+ * @param {sensor_sampler_stat_t*} st: 输出的统计
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_sampler_stats(sensor_sampler_t *sp, sensor_sampler_stat_t *st);
+
+#endif
@@ -0,0 +1,376 @@
+#define _GNU_SOURCE
+#include <base/oserror.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/socket.h>
+#include <sys/time.h>
+#include <sys/un.h>
+#include "hal_utils_inner.h"
+#include "sensor_export.h"
+
+#define SENSOR_EXPORT_WIDTH     20      // 每个数值占的宽度，%.12g 最长19个字符
+#define SENSOR_EXPORT_SLOT_MAX  (SENSOR_SNAP_MAX * 4 + 1)
+#define SENSOR_EXPORT_SEND_MS   1000    // 客户端不读时最多阻塞的时间
+
+// 模板中需要随快照改写的数值
+typedef enum {
+    SENSOR_EXPORT_SEQ,
+    SENSOR_EXPORT_VALUE,
+    SENSOR_EXPORT_MAX,
+    SENSOR_EXPORT_OK,
+    SENSOR_EXPORT_STATE,
+} sensor_export_kind_e;
+
+typedef struct {
+    uint32_t off;                       // 数值在缓冲区中的位置
+    uint8_t kind;                       // sensor_export_kind_e
+    uint8_t idx;                        // 快照中的下标
+} sensor_export_slot_t;
+
+struct sensor_export_t {
+    hal_device_sensor_t *dev;
+    char path[sizeof(((struct sockaddr_un *)0)->sun_path)];
+    int lfd;
+    int stop_fd;                        // 写入后服务线程退出
+    int stop;                           // 置1后更新线程在下一次等待超时后退出
+    pthread_t srv_tid;
+    pthread_t upd_tid;
+    pthread_mutex_t lock;               // 保护 active 和 readers
+    pthread_cond_t cond;                // 缓冲区不再被读取时广播
+    char *buf[2];                       // 双缓冲，更新不活动的一份后切换
+    size_t len;
+    int active;
+    int readers[2];
+    size_t slot_num;
+    sensor_export_slot_t slot[SENSOR_EXPORT_SLOT_MAX];
+    sensor_snapshot_t snap;             // 更新线程使用，避免每次在栈上复制
+};
+
+static const char *const sensor_export_type[] = {
+    [HAL_SEN_TEMP] = "temp",
+    [HAL_SEN_FAN] = "fan",
+    [HAL_SEN_VOL] = "vol",
+    [HAL_SEN_DISCRETE] = "discrete",
+    [HAL_SEN_WATTS] = "watts",
+};
+
+static const char *sensor_export_type_name(int type)
+{
+    if (type < 0 || type >= (int)HAL_ARRSZ(sensor_export_type) || !sensor_export_type[type])
+        return "unknown";
+    return sensor_export_type[type];
+}
+
+// 数值右对齐写入固定宽度，前面补空格
+static void sensor_export_put(char *dst, const char *fmt, double v)
+{
+    char tmp[32];
+    int n = snprintf(tmp, sizeof(tmp), fmt, v);
+    if (n < 0 || n > SENSOR_EXPORT_WIDTH)
+        n = snprintf(tmp, sizeof(tmp), "NaN");
+    memset(dst, ' ', SENSOR_EXPORT_WIDTH - n);
+    memcpy(dst + SENSOR_EXPORT_WIDTH - n, tmp, n);
+}
+
+// 追加一行文本，slot 非 NULL 时在行尾留出数值的位置
+static int sensor_export_text(sensor_export_t *ex, const sensor_export_slot_t *slot, const char *fmt, ...)
+{
+    char *buf = ex->buf[0];
+    size_t room = SENSOR_EXPORT_BUF - ex->len;
+
+    va_list ap;
+    va_start(ap, fmt);
+    int n = vsnprintf(buf + ex->len, room, fmt, ap);
+    va_end(ap);
+    ASSERT_FR(n >= 0 && (size_t)n < room, -ENOSPC, "export buffer too small");
+    ex->len += n;
+    if (!slot)
+        return 0;
+
+    ASSERT_FR(ex->len + 1 + SENSOR_EXPORT_WIDTH + 1 <= SENSOR_EXPORT_BUF, -ENOSPC, "export buffer too small");
+    ASSERT_FR(ex->slot_num < SENSOR_EXPORT_SLOT_MAX, -ENOSPC, "too many export slots");
+    buf[ex->len++] = ' ';
+    ex->slot[ex->slot_num] = *slot;
+    ex->slot[ex->slot_num++].off = ex->len;
+    sensor_export_put(buf + ex->len, "%.0f", 0);
+    ex->len += SENSOR_EXPORT_WIDTH;
+    buf[ex->len++] = '\n';
+    return 0;
+}
+
+// 按快照中的传感器生成模板，同一指标的行放在一起
+static int sensor_export_build(sensor_export_t *ex)
+{
+    const sensor_snapshot_t *snap = &ex->snap;
+    int ret = 0;
+
+    ret |= sensor_export_text(ex, NULL, "# HELP hal_sensor_sweep_seq Sequence number of the last published sweep.\n"
+                                        "# TYPE hal_sensor_sweep_seq counter\n");
+    ret |= sensor_export_text(ex, &(sensor_export_slot_t){ .kind = SENSOR_EXPORT_SEQ }, "hal_sensor_sweep_seq");
+
+    ret |= sensor_export_text(ex, NULL, "# HELP hal_sensor_value Last reading of the sensor, NaN when the read failed.\n"
+                                        "# TYPE hal_sensor_value gauge\n");
+    for (size_t i = 0; i < snap->num; i++) {
+        const sensor_reading_t *r = &snap->r[i];
+        if (r->type == HAL_SEN_DISCRETE)
+            continue;
+        ret |= sensor_export_text(ex, &(sensor_export_slot_t){ .kind = SENSOR_EXPORT_VALUE, .idx = i },
+                                  "hal_sensor_value{id=\"%d\",type=\"%s\"}", r->id, sensor_export_type_name(r->type));
+    }
+
+    ret |= sensor_export_text(ex, NULL, "# HELP hal_sensor_min Lower limit of the sensor.\n"
+                                        "# TYPE hal_sensor_min gauge\n");
+    for (size_t i = 0; i < snap->num; i++) {
+        const sensor_reading_t *r = &snap->r[i];
+        if (r->type != HAL_SEN_DISCRETE)
+            ret |= sensor_export_text(ex, NULL, "hal_sensor_min{id=\"%d\",type=\"%s\"} %.12g\n",
+                                      r->id, sensor_export_type_name(r->type), r->min);
+    }
+
+    ret |= sensor_export_text(ex, NULL, "# HELP hal_sensor_max Upper limit of the sensor, PSU limits follow the model.\n"
+                                        "# TYPE hal_sensor_max gauge\n");
+    for (size_t i = 0; i < snap->num; i++) {
+        const sensor_reading_t *r = &snap->r[i];
+        if (r->type == HAL_SEN_DISCRETE)
+            continue;
+        ret |= sensor_export_text(ex, &(sensor_export_slot_t){ .kind = SENSOR_EXPORT_MAX, .idx = i },
+                                  "hal_sensor_max{id=\"%d\",type=\"%s\"}", r->id, sensor_export_type_name(r->type));
+    }
+
+    ret |= sensor_export_text(ex, NULL, "# HELP hal_sensor_ok Whether the last read of the sensor succeeded.\n"
+                                        "# TYPE hal_sensor_ok gauge\n");
+    for (size_t i = 0; i < snap->num; i++) {
+        const sensor_reading_t *r = &snap->r[i];
+        ret |= sensor_export_text(ex, &(sensor_export_slot_t){ .kind = SENSOR_EXPORT_OK, .idx = i },
+                                  "hal_sensor_ok{id=\"%d\",type=\"%s\"}", r->id, sensor_export_type_name(r->type));
+    }
+
+    ret |= sensor_export_text(ex, NULL, "# HELP hal_psu_state PSU state as HAL_PSU_STAT_*, -1 when unknown.\n"
+                                        "# TYPE hal_psu_state gauge\n");
+    for (size_t i = 0; i < snap->num; i++) {
+        const sensor_reading_t *r = &snap->r[i];
+        if (r->type == HAL_SEN_DISCRETE)
+            ret |= sensor_export_text(ex, &(sensor_export_slot_t){ .kind = SENSOR_EXPORT_STATE, .idx = i },
+                                      "hal_psu_state{id=\"%d\"}", r->id);
+    }
+    return ret ? -ENOSPC : 0;
+}
+
+// 只改写数值，模板的其它部分不变
+static void sensor_export_render(sensor_export_t *ex, char *buf)
+{
+    const sensor_snapshot_t *snap = &ex->snap;
+
+    for (size_t i = 0; i < ex->slot_num; i++) {
+        const sensor_export_slot_t *slot = &ex->slot[i];
+        const sensor_reading_t *r = &snap->r[slot->idx];
+        char *dst = buf + slot->off;
+
+        switch (slot->kind) {
+        case SENSOR_EXPORT_SEQ:
+            sensor_export_put(dst, "%.0f", snap->seq);
+            break;
+        case SENSOR_EXPORT_VALUE:
+            if (r->ok && r->stamp.seq)
+                sensor_export_put(dst, "%.12g", r->value);
+            else
+                sensor_export_put(dst, "NaN", 0);
+            break;
+        case SENSOR_EXPORT_MAX:
+            sensor_export_put(dst, "%.12g", r->max);
+            break;
+        case SENSOR_EXPORT_OK:
+            sensor_export_put(dst, "%.0f", r->ok && r->stamp.seq);
+            break;
+        case SENSOR_EXPORT_STATE:
+            sensor_export_put(dst, "%.0f", r->ok && r->stamp.seq ? r->state : -1);
+            break;
+        }
+    }
+}
+
+// 改写不活动的一份，等正在读它的抓取结束后再写，写完切换
+static void sensor_export_update(sensor_export_t *ex)
+{
+    pthread_mutex_lock(&ex->lock);
+    int idle = !ex->active;
+    while (ex->readers[idle])
+        pthread_cond_wait(&ex->cond, &ex->lock);
+    pthread_mutex_unlock(&ex->lock);
+
+    sensor_export_render(ex, ex->buf[idle]);
+
+    pthread_mutex_lock(&ex->lock);
+    ex->active = idle;
+    pthread_mutex_unlock(&ex->lock);
+}
+
+static void *sensor_export_update_thread(void *arg)
+{
+    sensor_export_t *ex = arg;
+    uint64_t seq = ex->snap.seq;
+
+    while (!__atomic_load_n(&ex->stop, __ATOMIC_ACQUIRE)) {
+        int ret = sensor_wait_newer(ex->dev, seq, 200, &ex->snap);
+        if (ret == -ETIMEDOUT)
+            continue;
+        if (ret) {
+            HAL_ERR("export wait snapshot fail(%d)!", ret);
+            break;
+        }
+        seq = ex->snap.seq;
+        sensor_export_update(ex);
+    }
+    return NULL;
+}
+
+static void sensor_export_serve(sensor_export_t *ex, int fd)
+{
+    struct timeval tv = {
+        .tv_sec = SENSOR_EXPORT_SEND_MS / 1000,
+        .tv_usec = (SENSOR_EXPORT_SEND_MS % 1000) * 1000,
+    };
+    setsockopt(fd, SOL_SOCKET, SO_SNDTIMEO, &tv, sizeof(tv));
+
+    pthread_mutex_lock(&ex->lock);
+    int idx = ex->active;
+    ex->readers[idx]++;
+    pthread_mutex_unlock(&ex->lock);
+
+    // 缓冲区远小于 socket 发送缓冲区，正常情况下一次发完
+    size_t off = 0;
+    while (off < ex->len) {
+        ssize_t n = send(fd, ex->buf[idx] + off, ex->len - off, MSG_NOSIGNAL);
+        if (n <= 0)
+            break;
+        off += n;
+    }
+
+    pthread_mutex_lock(&ex->lock);
+    if (--ex->readers[idx] == 0)
+        pthread_cond_broadcast(&ex->cond);
+    pthread_mutex_unlock(&ex->lock);
+}
+
+static void *sensor_export_server_thread(void *arg)
+{
+    sensor_export_t *ex = arg;
+    struct pollfd fds[2] = {
+        { .fd = ex->lfd, .events = POLLIN },
+        { .fd = ex->stop_fd, .events = POLLIN },
+    };
+
+    for (;;) {
+        if (poll(fds, HAL_ARRSZ(fds), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            HAL_ERR("export poll fail!");
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        int fd = accept4(ex->lfd, NULL, NULL, SOCK_CLOEXEC);
+        if (fd < 0)
+            continue;
+        sensor_export_serve(ex, fd);
+        close(fd);
+    }
+    return NULL;
+}
+
+static int sensor_export_listen(sensor_export_t *ex)
+{
+    struct sockaddr_un addr = { .sun_family = AF_UNIX };
+    strcpy(addr.sun_path, ex->path);
+    unlink(ex->path);
+
+    ex->lfd = socket(AF_UNIX, SOCK_STREAM | SOCK_CLOEXEC, 0);
+    ASSERT_FR(ex->lfd >= 0, -errno, "create export socket fail!");
+    ASSERT_FR(bind(ex->lfd, (struct sockaddr *)&addr, sizeof(addr)) == 0, -errno, "bind %s fail!", ex->path);
+    ASSERT_FR(listen(ex->lfd, 8) == 0, -errno, "listen %s fail!", ex->path);
+    return 0;
+}
+
+static void sensor_export_free(sensor_export_t *ex)
+{
+    if (ex->lfd >= 0) {
+        close(ex->lfd);
+        unlink(ex->path);
+    }
+    if (ex->stop_fd >= 0)
+        close(ex->stop_fd);
+    free(ex->buf[0]);
+    free(ex->buf[1]);
+    pthread_mutex_destroy(&ex->lock);
+    pthread_cond_destroy(&ex->cond);
+    free(ex);
+}
+
+HAL_API sensor_export_t *sensor_export_start(hal_device_sensor_t *dev, const char *path)
+{
+    ASSERT_FR(dev && path, NULL, "Invalid argument");
+    ASSERT_FR(strlen(path) < sizeof(((struct sockaddr_un *)0)->sun_path), NULL, "socket path too long");
+
+    sensor_export_t *ex = calloc(1, sizeof(sensor_export_t));
+    ASSERT_FR(ex, NULL, "malloc fail!");
+    ex->dev = dev;
+    strcpy(ex->path, path);
+    ex->lfd = -1;
+    ex->stop_fd = -1;
+    pthread_mutex_init(&ex->lock, NULL);
+    pthread_cond_init(&ex->cond, NULL);
+
+    ex->buf[0] = malloc(SENSOR_EXPORT_BUF);
+    ex->buf[1] = malloc(SENSOR_EXPORT_BUF);
+    ASSERT_FG(ex->buf[0] && ex->buf[1], fail, "malloc fail!");
+
+    int ret = sensor_snapshot(dev, &ex->snap);
+    ASSERT_FG(ret == 0, fail, "get snapshot fail(%d)!", ret);
+    ret = sensor_export_build(ex);
+    ASSERT_FG(ret == 0, fail, "build export template fail(%d)!", ret);
+    sensor_export_render(ex, ex->buf[0]);
+    memcpy(ex->buf[1], ex->buf[0], ex->len);
+
+    ex->stop_fd = eventfd(0, EFD_CLOEXEC);
+    ASSERT_FG(ex->stop_fd >= 0, fail, "create export eventfd fail!");
+    ret = sensor_export_listen(ex);
+    ASSERT_FG(ret == 0, fail, "listen export socket fail(%d)!", ret);
+
+    ret = pthread_create(&ex->upd_tid, NULL, sensor_export_update_thread, ex);
+    ASSERT_FG(ret == 0, fail, "create export thread fail(%d)!", ret);
+    ret = pthread_create(&ex->srv_tid, NULL, sensor_export_server_thread, ex);
+    if (ret) {
+        HAL_ERR("create export thread fail(%d)!", ret);
+        __atomic_store_n(&ex->stop, 1, __ATOMIC_RELEASE);
+        pthread_join(ex->upd_tid, NULL);
+        goto fail;
+    }
+    return ex;
+fail:
+    sensor_export_free(ex);
+    return NULL;
+}
+
+HAL_API void sensor_export_stop(sensor_export_t *ex)
+{
+    if (!ex)
+        return;
+
+    uint64_t one = 1;
+    __atomic_store_n(&ex->stop, 1, __ATOMIC_RELEASE);
+    if (write(ex->stop_fd, &one, sizeof(one)) != sizeof(one))
+        HAL_ERR("stop export fail!");
+    pthread_join(ex->srv_tid, NULL);
+    pthread_join(ex->upd_tid, NULL);
+    sensor_export_free(ex);
+}
@@ -0,0 +1,27 @@
+#ifndef __SXF_SENSOR_EXPORT_H__
+#define __SXF_SENSOR_EXPORT_H__
+
+#include "sensor.h"
+
+#define SENSOR_EXPORT_BUF   16384   // 预先分配的输出缓冲区大小，所有指标必须能放下
+
+typedef struct sensor_export_t sensor_export_t;
+
+/**
+ * @description: 在本地 Unix socket 上以 Prometheus 文本格式导出所有传感器和电源的最近读数
+ *               启动时按快照中的传感器生成固定的文本模板，每个数值占固定宽度；
+ *               每发布一次新快照只在模板中原地改写数值，客户端连接后一次 send 发完即关闭，
+ *               抓取过程中不分配内存也不格式化，例如 socat - UNIX-CONNECT:<path>
+ *               导出器自己不触发扫描，读数来自 sensor_sampler 等调用者的扫描
+ * @param {hal_device_sensor_t*} dev: 传感器设备，需在 sensor_export_stop 之后再关闭
+ * @param {const char*} path: socket 路径，已存在时先删除
+ * @return {sensor_export_t*} 成功: 导出器句柄, 失败: NULL
+ */
+sensor_export_t *sensor_export_start(hal_device_sensor_t *dev, const char *path);
+/**
+ * @description: 停止导出并删除 socket 文件
+ * @param {sensor_export_t*} ex: 导出器句柄，NULL 时什么也不做
+ */
+void sensor_export_stop(sensor_export_t *ex);
+
+#endif
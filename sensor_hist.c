@@ -0,0 +1,565 @@
+#include <base/oserror.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include "hal_utils_inner.h"
+#include "sensor_hist.h"
+
+#define SENSOR_HIST_MAGIC       0x54534853  // "SHST"
+#define SENSOR_HIST_BLK_MAGIC   0x4b4c4248  // "HBLK"
+#define SENSOR_HIST_VERSION     1
+#define SENSOR_HIST_SAMPLE_BITS 113         // 单个点编码后的最大位数，时间戳 4+32，读数 2+5+6+64
+
+// 第0块，其余部分填0；字节序为本机字节序，文件不在不同架构之间拷贝
+typedef struct {
+    uint32_t magic;
+    uint16_t version;
+    uint16_t block_size;
+    uint32_t max_blocks;
+} sensor_hist_head_t;
+
+// 数据块，每块只包含一个序列，可以单独解码
+typedef struct {
+    uint32_t magic;
+    uint32_t seq;                       // 块的分配顺序，重新打开时从最大的继续
+    uint16_t series;
+    uint16_t count;                     // 块内的点数
+    uint32_t nbits;                     // data 中已使用的位数
+    uint64_t t_first;                   // 第一个点的时间戳，不再写入 data
+    uint64_t t_last;
+    uint8_t data[SENSOR_HIST_BLOCK - 32];
+} sensor_hist_block_t;
+
+#define SENSOR_HIST_CAP_BITS    (sizeof(((sensor_hist_block_t *)0)->data) * 8)
+
+// 正在写入的块及编码状态
+typedef struct {
+    sensor_hist_block_t blk;
+    uint32_t slot;                      // 块在文件中的位置
+    int64_t delta;                      // 上一个时间戳差分
+    uint64_t value;                     // 上一个读数的位模式
+    uint8_t lead;                       // 上一个有效位窗口，lead 为 0xff 表示还没有窗口
+    uint8_t trail;
+} sensor_hist_series_t;
+
+struct sensor_hist_t {
+    int fd;
+    pthread_mutex_t lock;
+    uint32_t max_blocks;
+    uint32_t next_slot;
+    uint32_t seq;
+    sensor_hist_series_t *series[SENSOR_HIST_SERIES_MAX];
+};
+
+// 位流按高位在前的顺序写入
+static void sensor_hist_put(sensor_hist_block_t *blk, uint64_t v, int n)
+{
+    while (n > 0) {
+        uint32_t off = blk->nbits & 7;
+        int room = 8 - off;
+        int take = n < room ? n : room;
+        uint8_t bits = (v >> (n - take)) & ((1u << take) - 1);
+        blk->data[blk->nbits >> 3] |= bits << (room - take);
+        blk->nbits += take;
+        n -= take;
+    }
+}
+
+typedef struct {
+    const uint8_t *data;
+    uint32_t nbits;
+    uint32_t pos;
+} sensor_hist_reader_t;
+
+static int sensor_hist_get(sensor_hist_reader_t *rd, int n, uint64_t *v)
+{
+    if (rd->pos + n > rd->nbits)
+        return -1;
+
+    uint64_t out = 0;
+    while (n > 0) {
+        uint32_t off = rd->pos & 7;
+        int room = 8 - off;
+        int take = n < room ? n : room;
+        uint8_t byte = rd->data[rd->pos >> 3];
+        out = (out << take) | ((byte >> (room - take)) & ((1u << take) - 1));
+        rd->pos += take;
+        n -= take;
+    }
+    *v = out;
+    return 0;
+}
+
+static uint64_t sensor_hist_bits(double v)
+{
+    uint64_t u;
+    memcpy(&u, &v, sizeof(u));
+    return u;
+}
+
+static double sensor_hist_double(uint64_t u)
+{
+    double v;
+    memcpy(&v, &u, sizeof(v));
+    return v;
+}
+
+// 时间戳二阶差分，超出32位时返回-1，由调用者另起一块
+static int sensor_hist_put_ts(sensor_hist_block_t *blk, int64_t dod)
+{
+    if (dod == 0) {
+        sensor_hist_put(blk, 0, 1);
+    } else if (dod >= -63 && dod <= 64) {
+        sensor_hist_put(blk, 0x2, 2);
+        sensor_hist_put(blk, dod + 63, 7);
+    } else if (dod >= -255 && dod <= 256) {
+        sensor_hist_put(blk, 0x6, 3);
+        sensor_hist_put(blk, dod + 255, 9);
+    } else if (dod >= -2047 && dod <= 2048) {
+        sensor_hist_put(blk, 0xe, 4);
+        sensor_hist_put(blk, dod + 2047, 12);
+    } else if (dod >= INT32_MIN && dod <= INT32_MAX) {
+        sensor_hist_put(blk, 0xf, 4);
+        sensor_hist_put(blk, (uint32_t)dod, 32);
+    } else {
+        return -1;
+    }
+    return 0;
+}
+
+static int sensor_hist_get_ts(sensor_hist_reader_t *rd, int64_t *dod)
+{
+    // 前缀最多4位，遇到0结束
+    static const struct { int bits; int64_t bias; } fmt[] = {
+        { 7, 63 }, { 9, 255 }, { 12, 2047 }, { 32, 0 },
+    };
+    uint64_t bit, v;
+    int i;
+    for (i = 0; i < 4; i++) {
+        if (sensor_hist_get(rd, 1, &bit))
+            return -1;
+        if (!bit)
+            break;
+    }
+    if (i == 0) {
+        *dod = 0;
+        return 0;
+    }
+    if (sensor_hist_get(rd, fmt[i - 1].bits, &v))
+        return -1;
+    *dod = i == 4 ? (int64_t)(int32_t)v : (int64_t)v - fmt[i - 1].bias;
+    return 0;
+}
+
+// 读数与上一个读数异或，相同时只占1位，有效位落在上一个窗口内时不重复写窗口
+static void sensor_hist_put_value(sensor_hist_series_t *s, uint64_t value)
+{
+    sensor_hist_block_t *blk = &s->blk;
+    uint64_t x = value ^ s->value;
+    s->value = value;
+    if (!x) {
+        sensor_hist_put(blk, 0, 1);
+        return;
+    }
+
+    int lead = __builtin_clzll(x);
+    int trail = __builtin_ctzll(x);
+    if (lead > 31)
+        lead = 31;
+    if (s->lead != 0xff && lead >= s->lead && trail >= s->trail) {
+        sensor_hist_put(blk, 0x2, 2);
+        sensor_hist_put(blk, x >> s->trail, 64 - s->lead - s->trail);
+        return;
+    }
+
+    int len = 64 - lead - trail;
+    sensor_hist_put(blk, 0x3, 2);
+    sensor_hist_put(blk, lead, 5);
+    sensor_hist_put(blk, len & 63, 6);  // 64位全有效时写0
+    sensor_hist_put(blk, x >> trail, len);
+    s->lead = lead;
+    s->trail = trail;
+}
+
+static int sensor_hist_get_value(sensor_hist_reader_t *rd, uint64_t *value, uint8_t *lead, uint8_t *trail)
+{
+    uint64_t bit, v;
+    if (sensor_hist_get(rd, 1, &bit))
+        return -1;
+    if (!bit)
+        return 0;
+    if (sensor_hist_get(rd, 1, &bit))
+        return -1;
+
+    if (bit) {
+        uint64_t l, len;
+        if (sensor_hist_get(rd, 5, &l) || sensor_hist_get(rd, 6, &len))
+            return -1;
+        if (len == 0)
+            len = 64;
+        if (l + len > 64)
+            return -1;
+        *lead = l;
+        *trail = 64 - l - len;
+    } else if (*lead == 0xff) {
+        return -1;
+    }
+
+    int len = 64 - *lead - *trail;
+    if (sensor_hist_get(rd, len, &v))
+        return -1;
+    *value ^= v << *trail;
+    return 0;
+}
+
+static int sensor_hist_write_block(sensor_hist_t *h, sensor_hist_series_t *s)
+{
+    off_t off = (off_t)s->slot * SENSOR_HIST_BLOCK;
+    ssize_t n = pwrite(h->fd, &s->blk, sizeof(s->blk), off);
+    ASSERT_FR(n == sizeof(s->blk), n < 0 ? -errno : -EIO, "write history block %u fail!", s->slot);
+    return 0;
+}
+
+// 分配下一个块的位置，写满上限后回到第1块，跳过其它序列正在写入的块
+static uint32_t sensor_hist_alloc_slot(sensor_hist_t *h)
+{
+    for (;;) {
+        uint32_t slot = h->next_slot++;
+        if (h->max_blocks && h->next_slot > h->max_blocks)
+            h->next_slot = 1;
+
+        int busy = 0;
+        for (int i = 0; i < SENSOR_HIST_SERIES_MAX && !busy; i++)
+            busy = h->series[i] && h->series[i]->blk.count && h->series[i]->slot == slot;
+        if (!busy)
+            return slot;
+    }
+}
+
+static void sensor_hist_start(sensor_hist_t *h, sensor_hist_series_t *s, uint16_t series,
+                              uint64_t ts_ms, uint64_t value)
+{
+    memset(&s->blk, 0, sizeof(s->blk));
+    s->slot = sensor_hist_alloc_slot(h);
+    s->blk.magic = SENSOR_HIST_BLK_MAGIC;
+    s->blk.seq = h->seq++;
+    s->blk.series = series;
+    s->blk.count = 1;
+    s->blk.t_first = ts_ms;
+    s->blk.t_last = ts_ms;
+    sensor_hist_put(&s->blk, value, 64);
+    s->delta = 0;
+    s->value = value;
+    s->lead = 0xff;
+    s->trail = 0;
+}
+
+static sensor_hist_series_t *sensor_hist_find(sensor_hist_t *h, uint16_t series)
+{
+    int idle = -1;
+    for (int i = 0; i < SENSOR_HIST_SERIES_MAX; i++) {
+        sensor_hist_series_t *s = h->series[i];
+        if (s && s->blk.series == series)
+            return s;
+        if (!s && idle < 0)
+            idle = i;
+    }
+    ASSERT_FR(idle >= 0, NULL, "too many history series!");
+
+    sensor_hist_series_t *s = calloc(1, sizeof(sensor_hist_series_t));
+    ASSERT_FR(s, NULL, "malloc fail!");
+    s->blk.series = series;
+    h->series[idle] = s;
+    return s;
+}
+
+// 扫描已有的块，找到最后分配的位置继续写
+static int sensor_hist_load(sensor_hist_t *h)
+{
+    sensor_hist_head_t head;
+    ssize_t n = pread(h->fd, &head, sizeof(head), 0);
+    ASSERT_FR(n == sizeof(head), -EIO, "read history head fail!");
+    ASSERT_FR(head.magic == SENSOR_HIST_MAGIC && head.version == SENSOR_HIST_VERSION &&
+              head.block_size == SENSOR_HIST_BLOCK, -EINVAL, "bad history head!");
+    h->max_blocks = head.max_blocks;
+
+    struct stat st;
+    ASSERT_FR(fstat(h->fd, &st) == 0, -errno, "stat history fail!");
+    uint32_t slots = st.st_size / SENSOR_HIST_BLOCK;
+
+    int found = 0;
+    uint32_t last = 0;
+    for (uint32_t i = 1; i < slots; i++) {
+        sensor_hist_block_t hdr;
+        if (pread(h->fd, &hdr, offsetof(sensor_hist_block_t, data), (off_t)i * SENSOR_HIST_BLOCK) !=
+            offsetof(sensor_hist_block_t, data))
+            break;
+        if (hdr.magic != SENSOR_HIST_BLK_MAGIC)
+            continue;
+        if (!found || (int32_t)(hdr.seq - h->seq) >= 0) {
+            h->seq = hdr.seq;
+            last = i;
+            found = 1;
+        }
+    }
+
+    h->next_slot = found ? last + 1 : 1;
+    if (h->max_blocks && h->next_slot > h->max_blocks)
+        h->next_slot = 1;
+    h->seq = found ? h->seq + 1 : 0;
+    return 0;
+}
+
+static int sensor_hist_create(sensor_hist_t *h, const sensor_hist_cfg_t *cfg)
+{
+    uint8_t buf[SENSOR_HIST_BLOCK] = {0};
+    sensor_hist_head_t *head = (sensor_hist_head_t *)buf;
+    head->magic = SENSOR_HIST_MAGIC;
+    head->version = SENSOR_HIST_VERSION;
+    head->block_size = SENSOR_HIST_BLOCK;
+    head->max_blocks = cfg ? cfg->max_blocks : 0;
+
+    ssize_t n = pwrite(h->fd, buf, sizeof(buf), 0);
+    ASSERT_FR(n == sizeof(buf), -EIO, "write history head fail!");
+    h->max_blocks = head->max_blocks;
+    h->next_slot = 1;
+    h->seq = 0;
+    return fdatasync(h->fd) ? -errno : 0;
+}
+
+HAL_API sensor_hist_t *sensor_hist_open(const char *path, const sensor_hist_cfg_t *cfg)
+{
+    ASSERT_FR(path, NULL, "Invalid argument");
+    // 上限太小时回绕会撞上其它序列正在写入的块
+    ASSERT_FR(!cfg || !cfg->max_blocks || cfg->max_blocks > SENSOR_HIST_SERIES_MAX, NULL,
+              "history max_blocks %u too small", cfg->max_blocks);
+
+    sensor_hist_t *h = calloc(1, sizeof(sensor_hist_t));
+    ASSERT_FR(h, NULL, "malloc fail!");
+    pthread_mutex_init(&h->lock, NULL);
+
+    h->fd = open(path, O_RDWR | O_CREAT | O_CLOEXEC, 0644);
+    ASSERT_FG(h->fd >= 0, fail, "open history %s fail!", path);
+
+    struct stat st;
+    ASSERT_FG(fstat(h->fd, &st) == 0, fail, "stat history %s fail!", path);
+    int ret = st.st_size ? sensor_hist_load(h) : sensor_hist_create(h, cfg);
+    ASSERT_FG(ret == 0, fail, "init history %s fail(%d)!", path, ret);
+    return h;
+fail:
+    if (h->fd >= 0)
+        close(h->fd);
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+    return NULL;
+}
+
+HAL_API void sensor_hist_close(sensor_hist_t *h)
+{
+    if (!h)
+        return;
+
+    sensor_hist_flush(h);
+    for (int i = 0; i < SENSOR_HIST_SERIES_MAX; i++)
+        free(h->series[i]);
+    close(h->fd);
+    pthread_mutex_destroy(&h->lock);
+    free(h);
+}
+
+// 调用时持有 h->lock
+static int sensor_hist_append_locked(sensor_hist_t *h, uint16_t series, uint64_t ts_ms, double value)
+{
+    sensor_hist_series_t *s = sensor_hist_find(h, series);
+    if (!s)
+        return -ENOSPC;
+
+    uint64_t bits = sensor_hist_bits(value);
+    if (!s->blk.count) {
+        sensor_hist_start(h, s, series, ts_ms, bits);
+        return 0;
+    }
+    ASSERT_FR(ts_ms >= s->blk.t_last, -OS_EINVAL, "history series %u time goes back", series);
+
+    int64_t delta = ts_ms - s->blk.t_last;
+    int64_t dod = delta - s->delta;
+    int ret = 0;
+    if (s->blk.nbits + SENSOR_HIST_SAMPLE_BITS > SENSOR_HIST_CAP_BITS || s->blk.count == UINT16_MAX ||
+        dod < INT32_MIN || dod > INT32_MAX) {
+        // 块已满或两点间隔太大，写出后另起一块
+        ret = sensor_hist_write_block(h, s);
+        sensor_hist_start(h, s, series, ts_ms, bits);
+        return ret;
+    }
+
+    sensor_hist_put_ts(&s->blk, dod);
+    sensor_hist_put_value(s, bits);
+    s->delta = delta;
+    s->blk.t_last = ts_ms;
+    s->blk.count++;
+    return 0;
+}
+
+HAL_API int sensor_hist_append(sensor_hist_t *h, uint16_t series, uint64_t ts_ms, double value)
+{
+    ASSERT_FR(h, -OS_EINVAL, "Invalid argument");
+
+    pthread_mutex_lock(&h->lock);
+    int ret = sensor_hist_append_locked(h, series, ts_ms, value);
+    pthread_mutex_unlock(&h->lock);
+    return ret;
+}
+
+HAL_API int sensor_hist_append_snapshot(sensor_hist_t *h, const sensor_snapshot_t *snap)
+{
+    ASSERT_FR(h && snap && snap->num <= SENSOR_SNAP_MAX, -OS_EINVAL, "Invalid argument");
+
+    struct timespec rt, mono;
+    clock_gettime(CLOCK_REALTIME, &rt);
+    clock_gettime(CLOCK_MONOTONIC, &mono);
+    uint64_t rt_ms = (uint64_t)rt.tv_sec * 1000ull + rt.tv_nsec / 1000000;
+    uint64_t mono_ns = (uint64_t)mono.tv_sec * 1000000000ull + mono.tv_nsec;
+
+    int ret = 0;
+    pthread_mutex_lock(&h->lock);
+    for (size_t i = 0; i < snap->num; i++) {
+        const sensor_reading_t *r = &snap->r[i];
+        // 只记录本次扫描读到的值，其它传感器保留的是旧读数
+        // 电源状态等离散传感器没有数值，value 恒为0，不占用序列和数据块
+        if (!r->ok || r->stamp.seq != snap->seq || r->type == HAL_SEN_DISCRETE)
+            continue;
+        uint64_t ns = r->stamp.end_ns ?: r->stamp.start_ns;
+        uint64_t age_ms = mono_ns > ns ? (mono_ns - ns) / 1000000 : 0;
+        int err = sensor_hist_append_locked(h, r->id, rt_ms - age_ms, r->value);
+        if (err && !ret)
+            ret = err;
+    }
+    pthread_mutex_unlock(&h->lock);
+    return ret;
+}
+
+HAL_API int sensor_hist_flush(sensor_hist_t *h)
+{
+    ASSERT_FR(h, -OS_EINVAL, "Invalid argument");
+
+    int ret = 0;
+    pthread_mutex_lock(&h->lock);
+    for (int i = 0; i < SENSOR_HIST_SERIES_MAX; i++) {
+        sensor_hist_series_t *s = h->series[i];
+        if (!s || !s->blk.count)
+            continue;
+        int err = sensor_hist_write_block(h, s);
+        if (err && !ret)
+            ret = err;
+    }
+    if (fdatasync(h->fd) && !ret)
+        ret = -errno;
+    pthread_mutex_unlock(&h->lock);
+    return ret;
+}
+
+// 同一序列的块时间不重叠，按起始时间排序即为时间顺序
+static int sensor_hist_cmp(const void *a, const void *b)
+{
+    const sensor_hist_block_t *x = *(const sensor_hist_block_t *const *)a;
+    const sensor_hist_block_t *y = *(const sensor_hist_block_t *const *)b;
+    if (x->t_first != y->t_first)
+        return x->t_first < y->t_first ? -1 : 1;
+    return (int32_t)(x->seq - y->seq) < 0 ? -1 : (x->seq != y->seq);
+}
+
+// 写入者可能正在覆盖这一块，所有读取都限制在块内，解码出错时丢弃该块剩余的点
+static int sensor_hist_decode(const sensor_hist_block_t *blk, uint64_t from_ms, uint64_t to_ms,
+                              sensor_hist_cb_t cb, void *priv)
+{
+    uint16_t series = blk->series;
+    uint16_t count = blk->count;
+    sensor_hist_reader_t rd = {
+        .data = blk->data,
+        .nbits = blk->nbits < SENSOR_HIST_CAP_BITS ? blk->nbits : SENSOR_HIST_CAP_BITS,
+    };
+
+    uint64_t ts = blk->t_first;
+    uint64_t value;
+    int64_t delta = 0;
+    uint8_t lead = 0xff, trail = 0;
+    if (sensor_hist_get(&rd, 64, &value))
+        return 0;
+
+    for (uint16_t i = 0; i < count; i++) {
+        if (i) {
+            int64_t dod;
+            if (sensor_hist_get_ts(&rd, &dod) || sensor_hist_get_value(&rd, &value, &lead, &trail))
+                break;
+            delta += dod;
+            ts += delta;
+        }
+        if (ts > to_ms)
+            break;
+        if (ts < from_ms)
+            continue;
+        int ret = cb(series, ts, sensor_hist_double(value), priv);
+        if (ret)
+            return ret;
+    }
+    return 0;
+}
+
+HAL_API int sensor_hist_scan(const char *path, uint16_t series, uint64_t from_ms, uint64_t to_ms,
+                             sensor_hist_cb_t cb, void *priv)
+{
+    ASSERT_FR(path && cb && from_ms <= to_ms, -OS_EINVAL, "Invalid argument");
+
+    int fd = open(path, O_RDONLY | O_CLOEXEC);
+    ASSERT_FR(fd >= 0, -errno, "open history %s fail!", path);
+
+    struct stat st;
+    int ret = fstat(fd, &st) ? -errno : 0;
+    size_t size = ret ? 0 : st.st_size / SENSOR_HIST_BLOCK * SENSOR_HIST_BLOCK;
+    if (size < SENSOR_HIST_BLOCK) {
+        close(fd);
+        return ret ?: -EINVAL;
+    }
+
+    const uint8_t *map = mmap(NULL, size, PROT_READ, MAP_SHARED, fd, 0);
+    close(fd);
+    ASSERT_FR(map != MAP_FAILED, -errno, "mmap history %s fail!", path);
+
+    const sensor_hist_head_t *head = (const sensor_hist_head_t *)map;
+    const sensor_hist_block_t **blks = NULL;
+    if (head->magic != SENSOR_HIST_MAGIC || head->version != SENSOR_HIST_VERSION ||
+        head->block_size != SENSOR_HIST_BLOCK) {
+        HAL_ERR("bad history head %s!", path);
+        ret = -EINVAL;
+        goto out;
+    }
+
+    // 先按块头筛出时间范围有交集的块，再排序解码
+    size_t slots = size / SENSOR_HIST_BLOCK, num = 0;
+    blks = calloc(slots, sizeof(*blks));
+    ASSERT_FG(blks, out, "malloc fail!");
+    for (size_t i = 1; i < slots; i++) {
+        const sensor_hist_block_t *blk = (const sensor_hist_block_t *)(map + i * SENSOR_HIST_BLOCK);
+        if (blk->magic != SENSOR_HIST_BLK_MAGIC || blk->series != series || !blk->count)
+            continue;
+        if (blk->t_last < from_ms || blk->t_first > to_ms)
+            continue;
+        blks[num++] = blk;
+    }
+    qsort(blks, num, sizeof(*blks), sensor_hist_cmp);
+
+    for (size_t i = 0; i < num && !ret; i++)
+        ret = sensor_hist_decode(blks[i], from_ms, to_ms, cb, priv);
+out:
+    if (!blks && !ret)
+        ret = -ENOMEM;
+    free(blks);
+    munmap((void *)map, size);
+    return ret;
+}
@@ -0,0 +1,71 @@
+#ifndef __SXF_SENSOR_HIST_H__
+#define __SXF_SENSOR_HIST_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "sensor.h"
+
+#define SENSOR_HIST_BLOCK       4096    // 文件按固定大小的块写入，第0块为文件头
+#define SENSOR_HIST_SERIES_MAX  64      // 同时写入的序列个数上限
+
+// 历史文件配置，文件已存在时以文件头中的块数为准
+typedef struct {
+    uint32_t max_blocks;                // 数据块个数上限，写满后覆盖最旧的块，0表示不限制
+} sensor_hist_cfg_t;
+
+// 查询到的每个采样点，按时间先后调用，返回非0时停止查询
+typedef int (*sensor_hist_cb_t)(uint16_t series, uint64_t ts_ms, double value, void *priv);
+
+typedef struct sensor_hist_t sensor_hist_t;
+
+/**
+ * @description: 打开或创建历史文件用于追加写入，一个文件同一时间只能有一个写入者
+ *               时间戳和读数按 Gorilla 方式压缩（时间戳二阶差分、读数与上一个读数异或），
+ *               每个序列在内存中攒满一块后整块写入，周期采样时平均每个点只占几个字节
+ * @param {const char*} path: 文件路径
+ * @param {const sensor_hist_cfg_t*} cfg: 配置，NULL 表示使用默认值
+ * @return {sensor_hist_t*} 成功: 历史句柄, 失败: NULL
+ */
+sensor_hist_t *sensor_hist_open(const char *path, const sensor_hist_cfg_t *cfg);
+/**
+ * @description: 写入未满的块后关闭历史文件
+ * @param {sensor_hist_t*} h: 历史句柄，NULL 时什么也不做
+ */
+void sensor_hist_close(sensor_hist_t *h);
+/**
+ * @description: 追加一个采样点，只写内存，块写满时才写文件
+ * @param {sensor_hist_t*} h: 历史句柄
+ * @param {uint16_t} series: 序列号，例如 hal_sensor_id_e
+ * @param {uint64_t} ts_ms: CLOCK_REALTIME 毫秒时间戳，同一序列不能比上一个点早
+ * @param {double} value: 读数
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_hist_append(sensor_hist_t *h, uint16_t series, uint64_t ts_ms, double value);
+/**
+ * @description: 把快照中本次扫描读到的读数追加到历史，序列号为传感器id，不记录没有数值的离散传感器
+ *               读数的 CLOCK_MONOTONIC 时间戳按调用时刻换算成 CLOCK_REALTIME
+ * @param {sensor_hist_t*} h: 历史句柄
+ * @param {const sensor_snapshot_t*} snap: sensor_snapshot/sensor_wait_newer 返回的快照
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_hist_append_snapshot(sensor_hist_t *h, const sensor_snapshot_t *snap);
+/**
+ * @description: 把未满的块写回各自的位置并落盘，掉电时最多丢失上次 flush 之后的点
+ * @param {sensor_hist_t*} h: 历史句柄
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int sensor_hist_flush(sensor_hist_t *h);
+/**
+ * @description: 通过 mmap 只读扫描历史文件，按块头的时间范围跳过不相关的块，可与写入者并发
+ * @param {const char*} path: 文件路径
+ * @param {uint16_t} series: 序列号
+ * @param {uint64_t} from_ms: 起始时间（含）
+ * @param {uint64_t} to_ms: 结束时间（含）
+ * @param {sensor_hist_cb_t} cb: 每个采样点的回调
+ * @param {void*} priv: 回调的私有数据
+ * @return {int} 成功: 0, 失败: 回调的返回值或 -errno
+ */
+int sensor_hist_scan(const char *path, uint16_t series, uint64_t from_ms, uint64_t to_ms,
+                     sensor_hist_cb_t cb, void *priv);
+
+#endif
@@ -0,0 +1,193 @@
+#define _GNU_SOURCE
+#include <base/oserror.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <poll.h>
+#include <sched.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include <sys/timerfd.h>
+#include "hal_utils_inner.h"
+#include "sensor.h"
+#include "sensor_table.h"
+
+struct sensor_sampler_t {
+    hal_device_sensor_t *dev;
+    sensor_sampler_cfg_t cfg;           // cfg.filter.ids 指向 ids，不引用调用者的数组
+    hal_sensor_id_e ids[SENSOR_OBJ_MAX];
+    sensor_stamp_cb_t cb;
+    void *priv;
+    int tfd;                            // 周期定时器
+    int stop_fd;                        // 写入后采样线程退出
+    pthread_t tid;
+    uint64_t tick_ns;                   // 本次采样的计划时刻
+    pthread_mutex_t lock;               // 保护 stat
+    sensor_sampler_stat_t stat;
+};
+
+static uint64_t sensor_sampler_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+// 给每个读数补上计划时刻后转给调用者
+static int sensor_sampler_cb(hal_data_t *data, const sensor_stamp_t *st, void *priv)
+{
+    sensor_sampler_t *sp = priv;
+    sensor_stamp_t stamp = *st;
+    stamp.tick_ns = sp->tick_ns;
+    return sp->cb(data, &stamp, sp->priv);
+}
+
+// 绑核和实时优先级都是尽力而为，没有权限时仍按普通线程采样
+static void sensor_sampler_setup(sensor_sampler_t *sp)
+{
+    if (sp->cfg.cpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(sp->cfg.cpu, &set);
+        int ret = pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+        if (ret)
+            HAL_ERR("sampler bind cpu %d fail(%d)!", sp->cfg.cpu, ret);
+    }
+    if (sp->cfg.rt_prio > 0) {
+        struct sched_param param = { .sched_priority = sp->cfg.rt_prio };
+        int ret = pthread_setschedparam(pthread_self(), SCHED_FIFO, &param);
+        if (ret)
+            HAL_ERR("sampler set SCHED_FIFO %d fail(%d)!", sp->cfg.rt_prio, ret);
+    }
+}
+
+static void *sensor_sampler_thread(void *arg)
+{
+    sensor_sampler_t *sp = arg;
+    sensor_sampler_setup(sp);
+
+    const uint64_t period = (uint64_t)sp->cfg.period_ms * 1000000ull;
+    const sensor_filter_t *filter = &sp->cfg.filter;
+    if (!filter->types && !filter->id_num)
+        filter = NULL;
+
+    // 第一个周期从下一个周期开始，之后的计划时刻都由起点推算，不累积误差
+    uint64_t first = sensor_sampler_now_ns() + period;
+    struct itimerspec its = {
+        .it_interval = { period / 1000000000ull, period % 1000000000ull },
+        .it_value = { first / 1000000000ull, first % 1000000000ull },
+    };
+    if (timerfd_settime(sp->tfd, TFD_TIMER_ABSTIME, &its, NULL) < 0) {
+        HAL_ERR("sampler arm timer fail!");
+        return NULL;
+    }
+
+    struct pollfd fds[2] = {
+        { .fd = sp->tfd, .events = POLLIN },
+        { .fd = sp->stop_fd, .events = POLLIN },
+    };
+    uint64_t ticks = 0;
+    for (;;) {
+        if (poll(fds, HAL_ARRSZ(fds), -1) < 0) {
+            if (errno == EINTR)
+                continue;
+            HAL_ERR("sampler poll fail!");
+            break;
+        }
+        if (fds[1].revents)
+            break;
+        if (!(fds[0].revents & POLLIN))
+            continue;
+
+        // 超时次数大于1说明上一次采样跨过了周期，跳到最近的计划时刻
+        uint64_t exp = 0;
+        if (read(sp->tfd, &exp, sizeof(exp)) != sizeof(exp) || exp == 0)
+            continue;
+        ticks += exp;
+        sp->tick_ns = first + (ticks - 1) * period;
+
+        uint64_t start = sensor_sampler_now_ns();
+        int ret = sensor_iter_stamped(sp->dev, filter, sensor_sampler_cb, sp);
+        uint64_t end = sensor_sampler_now_ns();
+
+        uint64_t jitter = start > sp->tick_ns ? start - sp->tick_ns : 0;
+        pthread_mutex_lock(&sp->lock);
+        sensor_sampler_stat_t *st = &sp->stat;
+        st->samples++;
+        st->overruns += exp - 1;
+        if (ret)
+            st->errors++;
+        st->jitter_sum_ns += jitter;
+        if (jitter > st->jitter_max_ns)
+            st->jitter_max_ns = jitter;
+        st->last_ns = end - start;
+        pthread_mutex_unlock(&sp->lock);
+    }
+    return NULL;
+}
+
+HAL_API sensor_sampler_t *sensor_sampler_start(hal_device_sensor_t *dev, const sensor_sampler_cfg_t *cfg,
+                                               sensor_stamp_cb_t cb, void *priv)
+{
+    ASSERT_FR(dev && cfg && cfg->period_ms && cb, NULL, "Invalid argument");
+    ASSERT_FR(!cfg->filter.id_num || cfg->filter.ids, NULL, "Invalid argument");
+    ASSERT_FR(cfg->filter.id_num <= SENSOR_OBJ_MAX, NULL, "too many sensor ids(%zu)!", cfg->filter.id_num);
+
+    sensor_sampler_t *sp = calloc(1, sizeof(sensor_sampler_t));
+    ASSERT_FR(sp, NULL, "malloc fail!");
+    sp->dev = dev;
+    sp->cfg = *cfg;
+    // 采样线程在整个生命周期内使用筛选条件，复制一份，调用者启动后即可释放自己的数组
+    if (cfg->filter.id_num)
+        memcpy(sp->ids, cfg->filter.ids, cfg->filter.id_num * sizeof(sp->ids[0]));
+    sp->cfg.filter.ids = sp->ids;
+    sp->cb = cb;
+    sp->priv = priv;
+    sp->stop_fd = -1;
+    pthread_mutex_init(&sp->lock, NULL);
+
+    sp->tfd = timerfd_create(CLOCK_MONOTONIC, TFD_CLOEXEC);
+    ASSERT_FG(sp->tfd >= 0, fail, "create sampler timer fail!");
+    sp->stop_fd = eventfd(0, EFD_CLOEXEC);
+    ASSERT_FG(sp->stop_fd >= 0, fail, "create sampler eventfd fail!");
+
+    int ret = pthread_create(&sp->tid, NULL, sensor_sampler_thread, sp);
+    ASSERT_FG(ret == 0, fail, "create sampler thread fail(%d)!", ret);
+    return sp;
+fail:
+    if (sp->tfd >= 0)
+        close(sp->tfd);
+    if (sp->stop_fd >= 0)
+        close(sp->stop_fd);
+    pthread_mutex_destroy(&sp->lock);
+    free(sp);
+    return NULL;
+}
+
+HAL_API void sensor_sampler_stop(sensor_sampler_t *sp)
+{
+    if (!sp)
+        return;
+
+    uint64_t one = 1;
+    if (write(sp->stop_fd, &one, sizeof(one)) != sizeof(one))
+        HAL_ERR("stop sampler fail!");
+    pthread_join(sp->tid, NULL);
+
+    close(sp->tfd);
+    close(sp->stop_fd);
+    pthread_mutex_destroy(&sp->lock);
+    free(sp);
+}
+
+HAL_API int sensor_sampler_stats(sensor_sampler_t *sp, sensor_sampler_stat_t *st)
+{
+    ASSERT_FR(sp && st, -OS_EINVAL, "Invalid argument");
+
+    pthread_mutex_lock(&sp->lock);
+    *st = sp->stat;
+    pthread_mutex_unlock(&sp->lock);
+    return 0;
+}
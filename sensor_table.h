@@ -0,0 +1,63 @@
+#ifndef __SXF_SENSOR_TABLE_H__
+#define __SXF_SENSOR_TABLE_H__
+
+#include <stdint.h>
+#include <stddef.h>
+#include "hal_sensor.h"
+
+#define SENSOR_OBJ_MAX      32      // 单个平台最多支持的传感器个数
+#define SENSOR_BURST_MAX    16      // 单个平台最多支持的连续读区间个数
+#define SENSOR_BUF_MAX      128     // 单次扫描所有区间的缓冲区大小
+#define SENSOR_PSU_MAX      8       // 单个平台最多支持的电源个数，每个PMBus区间对应一个电源
+
+// 按对象下标选择传感器的位图
+typedef uint32_t sensor_mask_t;
+_Static_assert(SENSOR_OBJ_MAX <= 32 && SENSOR_BURST_MAX <= 32 && SENSOR_PSU_MAX <= 32,
+               "sensor_mask_t too small");
+
+// 传感器的访问方式，决定走哪条总线、用什么协议读取
+typedef enum {
+    SENSOR_ACC_MCU,         // 传感器总线上的MCU，读之前需要切换扩展寄存器
+    SENSOR_ACC_CPLD,        // 传感器总线上的CPLD，读之前需要切换扩展寄存器
+    SENSOR_ACC_FAN,         // 风扇总线上的MCU，不需要切换扩展寄存器
+    SENSOR_ACC_PMBUS,       // 电源总线上的PMBus设备，按寄存器逐个读取word
+} sensor_access_e;
+
+// 一次总线事务连续读取的寄存器区间
+typedef struct {
+    uint8_t access;         // sensor_access_e
+    uint8_t slave;          // 设备地址
+    uint8_t start;          // 起始寄存器
+    uint8_t len;            // 连续读取的字节数，PMBus区间为0
+    int8_t psu;             // PMBus区间对应的电源序号，其它为-1
+    uint16_t buf_off;       // 区间在扫描缓冲区中的起始位置
+} sensor_burst_t;
+
+typedef struct {
+    hal_sensor_id_e id;            // 传感器的名称id
+    hal_sensor_type_e type;        // 传感器的类型
+    uint8_t burst;                 // 所属的读取区间
+    int8_t psu;                    // 所属电源序号，非电源传感器为-1
+    uint8_t offset_h;              // 读取寄存器高字节偏移量
+    uint8_t offset_l;              // 读取寄存器低字节偏移量，PMBus为命令码
+    uint16_t idx_h;                // 高字节在扫描缓冲区中的位置
+    uint16_t idx_l;                // 低字节在扫描缓冲区中的位置
+    double factor;                 // 读取后的系数
+    double min;                    // 传感器的最小值
+    double max;                    // 传感器的最大值
+} sensor_object_t;
+
+typedef struct {
+    const char *name;              // 平台名称，与 family.platform 匹配
+    int sensor_bus;                // 传感器总线
+    int fan_bus;                   // 风扇总线
+    int psu_bus;                   // 电源总线
+    size_t burst_num;
+    const sensor_burst_t *bursts;  // 按总线分组，同一总线内按地址、起始寄存器升序排列(编译期检查)
+    size_t obj_num;
+    const sensor_object_t *objs;   // 按上报顺序排列
+    size_t buf_size;               // 所有区间总长度
+    size_t psu_num;                // 电源个数
+} sensor_platform_t;
+
+#endif
@@ -0,0 +1,156 @@
+/*
+ * 根据平台描述文件在编译期生成只读的传感器表，可被多次包含，因此没有头文件保护。
+ * 包含之前需要定义:
+ *   SENSOR_PLAT      平台标识符，例如 yudi
+ *   SENSOR_PLAT_DEF  平台描述文件，例如 "sensor_yudi.def"
+ * 生成: static const sensor_platform_t sensor_<plat>_platform
+ *
+ * 描述文件中可使用的宏:
+ *   SENSOR_PLATFORM(name, sensor_bus, fan_bus, psu_bus)
+ *   SENSOR_BURST(name, access, slave, start, len)
+ *   SENSOR_OBJ(type, id, burst, offset_l, offset_h, factor, min, max)
+ */
+#include "sensor_table.h"
+
+#if !defined SENSOR_PLAT || !defined SENSOR_PLAT_DEF
+#error "SENSOR_PLAT and SENSOR_PLAT_DEF must be defined"
+#endif
+
+#define SENSOR_GEN_CAT_(_a, _b) _a##_##_b
+#define SENSOR_GEN_CAT(_a, _b)  SENSOR_GEN_CAT_(_a, _b)
+#define SENSOR_SYM(_x)          SENSOR_GEN_CAT(SENSOR_GEN_CAT(sensor, SENSOR_PLAT), _x)
+
+#define SENSOR_PLATFORM(_name, _sbus, _fbus, _pbus)
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len)
+#define SENSOR_OBJ(_type, _id, _burst, _off_l, _off_h, _factor, _min, _max)
+
+/* 1. 区间序号, 起始寄存器, 长度, 访问方式 */
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len) SENSOR_SYM(B_##_name),
+enum {
+#include SENSOR_PLAT_DEF
+    SENSOR_SYM(BURST_NUM)
+};
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len) \
+    SENSOR_SYM(S_##_name) = (_start), SENSOR_SYM(L_##_name) = (_len), SENSOR_SYM(A_##_name) = (_acc),
+enum {
+#include SENSOR_PLAT_DEF
+};
+
+/* 2. 区间在扫描缓冲区中的偏移, 利用枚举自增在编译期累加 */
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len) \
+    SENSOR_SYM(O_##_name), SENSOR_SYM(E_##_name) = SENSOR_SYM(O_##_name) + (_len) - 1,
+enum {
+#include SENSOR_PLAT_DEF
+    SENSOR_SYM(BUF_SIZE)
+};
+
+/* 3. PMBus区间按顺序编号为电源序号, 同样利用枚举自增 */
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len) \
+    SENSOR_SYM(P_##_name), SENSOR_SYM(PE_##_name) = SENSOR_SYM(P_##_name) + ((_acc) == SENSOR_ACC_PMBUS) - 1,
+enum {
+#include SENSOR_PLAT_DEF
+    SENSOR_SYM(PSU_NUM)
+};
+
+/* 4. 区间顺序: 按访问方式所在的总线分组, 同一总线内按地址、起始寄存器严格升序
+ *    KP 由枚举自增得到上一个区间的键加1, 因此 K >= KP 即比上一个区间大 */
+#define SENSOR_BUS_ORD(_acc) \
+    ((_acc) == SENSOR_ACC_FAN ? 1 : (_acc) == SENSOR_ACC_PMBUS ? 2 : 0)
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len) \
+    SENSOR_SYM(KP_##_name), SENSOR_SYM(K_##_name) = (SENSOR_BUS_ORD(_acc) << 16) | ((_slave) << 8) | (_start),
+enum {
+#include SENSOR_PLAT_DEF
+};
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len) \
+    _Static_assert(SENSOR_SYM(K_##_name) >= SENSOR_SYM(KP_##_name), "burst " #_name " is out of order");
+#include SENSOR_PLAT_DEF
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len)
+
+_Static_assert(SENSOR_SYM(BURST_NUM) <= SENSOR_BURST_MAX, "too many sensor bursts");
+_Static_assert(SENSOR_SYM(PSU_NUM) <= SENSOR_PSU_MAX, "too many psu");
+_Static_assert(SENSOR_SYM(BUF_SIZE) <= SENSOR_BUF_MAX, "sensor burst buffer too small");
+
+static const sensor_burst_t SENSOR_SYM(bursts)[] = {
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len) \
+    {                                                                           \
+        .access = (_acc), .slave = (_slave), .start = (_start), .len = (_len),  \
+        .psu = (_acc) == SENSOR_ACC_PMBUS ? SENSOR_SYM(P_##_name) : -1,         \
+        .buf_off = SENSOR_SYM(O_##_name),                                       \
+    },
+#include SENSOR_PLAT_DEF
+};
+#undef SENSOR_BURST
+#define SENSOR_BURST(_name, _acc, _slave, _start, _len)
+
+/* 5. 传感器对象, 寄存器必须落在所属区间内 */
+#define SENSOR_IN_BURST(_burst, _off) \
+    ((_off) >= SENSOR_SYM(S_##_burst) && (_off) < SENSOR_SYM(S_##_burst) + SENSOR_SYM(L_##_burst))
+#define SENSOR_PSU_IDX(_burst) \
+    ((int)SENSOR_SYM(A_##_burst) == (int)SENSOR_ACC_PMBUS ? SENSOR_SYM(P_##_burst) : -1)
+#define SENSOR_BUF_IDX(_burst, _off) \
+    ((int)SENSOR_SYM(A_##_burst) == (int)SENSOR_ACC_PMBUS ? 0 : SENSOR_SYM(O_##_burst) + (_off) - SENSOR_SYM(S_##_burst))
+
+#undef SENSOR_OBJ
+#define SENSOR_OBJ(_type, _id, _burst, _off_l, _off_h, _factor, _min, _max)    \
+    _Static_assert((int)SENSOR_SYM(A_##_burst) == (int)SENSOR_ACC_PMBUS ||      \
+                   (SENSOR_IN_BURST(_burst, _off_l) &&                          \
+                    ((_off_h) == 0 || SENSOR_IN_BURST(_burst, _off_h))),        \
+                   #_id " is out of burst " #_burst);
+#include SENSOR_PLAT_DEF
+
+static const sensor_object_t SENSOR_SYM(objs)[] = {
+#undef SENSOR_OBJ
+#define SENSOR_OBJ(_type, _id, _burst, _off_l, _off_h, _factor, _min, _max)    \
+    {                                                                           \
+        .type = (_type), .id = (_id), .burst = SENSOR_SYM(B_##_burst),          \
+        .psu = SENSOR_PSU_IDX(_burst),                                          \
+        .offset_l = (_off_l), .offset_h = (_off_h),                             \
+        .idx_l = SENSOR_BUF_IDX(_burst, _off_l),                                \
+        .idx_h = SENSOR_BUF_IDX(_burst, (_off_h) ?: (_off_l)),                  \
+        .factor = (_factor), .min = (_min), .max = (_max),                      \
+    },
+#include SENSOR_PLAT_DEF
+};
+#undef SENSOR_OBJ
+#define SENSOR_OBJ(_type, _id, _burst, _off_l, _off_h, _factor, _min, _max)
+
+_Static_assert(sizeof(SENSOR_SYM(objs)) / sizeof(SENSOR_SYM(objs)[0]) <= SENSOR_OBJ_MAX,
+               "too many sensor objects");
+
+/* 6. 平台描述 */
+#undef SENSOR_PLATFORM
+#define SENSOR_PLATFORM(_name, _sbus, _fbus, _pbus)                                     \
+    static const sensor_platform_t SENSOR_SYM(platform) = {                             \
+        .name       = (_name),                                                          \
+        .sensor_bus = (_sbus),                                                          \
+        .fan_bus    = (_fbus),                                                          \
+        .psu_bus    = (_pbus),                                                          \
+        .burst_num  = SENSOR_SYM(BURST_NUM),                                            \
+        .bursts     = SENSOR_SYM(bursts),                                               \
+        .obj_num    = sizeof(SENSOR_SYM(objs)) / sizeof(SENSOR_SYM(objs)[0]),           \
+        .objs       = SENSOR_SYM(objs),                                                 \
+        .buf_size   = SENSOR_SYM(BUF_SIZE),                                             \
+        .psu_num    = SENSOR_SYM(PSU_NUM),                                              \
+    };
+#include SENSOR_PLAT_DEF
+
+#undef SENSOR_PLATFORM
+#undef SENSOR_BURST
+#undef SENSOR_OBJ
+#undef SENSOR_IN_BURST
+#undef SENSOR_BUF_IDX
+#undef SENSOR_BUS_ORD
+#undef SENSOR_PSU_IDX
+#undef SENSOR_SYM
+#undef SENSOR_GEN_CAT
+#undef SENSOR_GEN_CAT_
+#undef SENSOR_PLAT
+#undef SENSOR_PLAT_DEF
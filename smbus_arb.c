@@ -0,0 +1,173 @@
+#include <base/oserror.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <time.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <sys/file.h>
+#include "hal_utils_inner.h"
+#include "smbus_arb.h"
+
+#define SMBUS_ARB_MAGIC     0x53415242  // "SARB"
+#define SMBUS_ARB_SHM       "/hal-smbus-arb-"
+#define SMBUS_ARB_MODE      0660        // 同组的其它用户也要能打开，否则它们会绕过仲裁器切通路
+
+// 放在共享内存中，所有进程可见
+typedef struct {
+    uint32_t magic;                     // 初始化完成后最后写入，没有时由下一个打开者重新初始化
+    pthread_mutex_t lock;               // 进程间共享、健壮、可重入
+    pid_t mux_owner;                    // 最近一次切换mux的进程
+    uint8_t mux_valid;
+    uint8_t mux_slave;
+    uint8_t mux_chan;
+} smbus_arb_shm_t;
+
+struct smbus_arb_t {
+    smbus_arb_shm_t *shm;
+};
+
+static void smbus_arb_name(const char *dev, char *name, size_t size)
+{
+    // /dev/i2c-3 -> /hal-smbus-arb-i2c-3
+    const char *base = strrchr(dev, '/');
+    snprintf(name, size, SMBUS_ARB_SHM "%s", base ? base + 1 : dev);
+}
+
+// 持有共享内存文件的 flock 时调用，之前的初始化者中途退出时这里从头再来
+static int smbus_arb_init(smbus_arb_shm_t *shm)
+{
+    memset(shm, 0, sizeof(*shm));
+    pthread_mutexattr_t attr;
+    pthread_mutexattr_init(&attr);
+    pthread_mutexattr_setpshared(&attr, PTHREAD_PROCESS_SHARED);
+    pthread_mutexattr_setrobust(&attr, PTHREAD_MUTEX_ROBUST);
+    pthread_mutexattr_settype(&attr, PTHREAD_MUTEX_RECURSIVE);
+    int ret = pthread_mutex_init(&shm->lock, &attr);
+    pthread_mutexattr_destroy(&attr);
+    ASSERT_FR(ret == 0, -ret, "init arbiter lock fail!");
+
+    __atomic_store_n(&shm->magic, SMBUS_ARB_MAGIC, __ATOMIC_RELEASE);
+    return 0;
+}
+
+smbus_arb_t *smbus_arb_open(const char *dev)
+{
+    ASSERT_FR(dev, NULL, "Invalid argument");
+
+    char name[64];
+    smbus_arb_name(dev, name, sizeof(name));
+
+    int fd = shm_open(name, O_RDWR | O_CREAT, SMBUS_ARB_MODE);
+    ASSERT_FR(fd >= 0, NULL, "open arbiter %s fail: %s!", name, strerror(errno));
+
+    // 初始化在 flock 下进行，初始化者中途退出时锁随之释放，下一个打开者看不到 magic 就重新初始化
+    smbus_arb_shm_t *shm = MAP_FAILED;
+    int ret = flock(fd, LOCK_EX);
+    ASSERT_FG(ret == 0, fail, "lock arbiter %s fail: %s!", name, strerror(errno));
+
+    struct stat st;
+    ASSERT_FG(fstat(fd, &st) == 0, unlock, "stat arbiter %s fail!", name);
+    if (st.st_size < (off_t)sizeof(smbus_arb_shm_t)) {
+        // umask 会去掉组权限，创建后再设置一次
+        ASSERT_FG(fchmod(fd, SMBUS_ARB_MODE) == 0, unlock, "chmod arbiter %s fail!", name);
+        ASSERT_FG(ftruncate(fd, sizeof(smbus_arb_shm_t)) == 0, unlock, "resize arbiter %s fail!", name);
+    }
+
+    shm = mmap(NULL, sizeof(smbus_arb_shm_t), PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+    ASSERT_FG(shm != MAP_FAILED, unlock, "mmap arbiter %s fail!", name);
+
+    if (__atomic_load_n(&shm->magic, __ATOMIC_ACQUIRE) != SMBUS_ARB_MAGIC) {
+        ret = smbus_arb_init(shm);
+        ASSERT_FG(ret == 0, unlock, "arbiter %s not initialized!", name);
+    }
+    flock(fd, LOCK_UN);
+
+    smbus_arb_t *arb = calloc(1, sizeof(smbus_arb_t));
+    ASSERT_FG(arb, fail, "malloc fail!");
+    arb->shm = shm;
+    close(fd);
+    return arb;
+unlock:
+    flock(fd, LOCK_UN);
+fail:
+    if (shm != MAP_FAILED)
+        munmap(shm, sizeof(smbus_arb_shm_t));
+    close(fd);
+    return NULL;
+}
+
+void smbus_arb_close(smbus_arb_t *arb)
+{
+    if (!arb)
+        return;
+    munmap(arb->shm, sizeof(smbus_arb_shm_t));
+    free(arb);
+}
+
+int smbus_arb_lock(smbus_arb_t *arb)
+{
+    if (!arb)
+        return 0;
+
+    struct timespec ts;
+    clock_gettime(CLOCK_REALTIME, &ts);
+    ts.tv_sec += SMBUS_ARB_TIMEOUT_MS / 1000;
+    ts.tv_nsec += (SMBUS_ARB_TIMEOUT_MS % 1000) * 1000000L;
+    if (ts.tv_nsec >= 1000000000L) {
+        ts.tv_sec++;
+        ts.tv_nsec -= 1000000000L;
+    }
+
+    int ret = pthread_mutex_timedlock(&arb->shm->lock, &ts);
+    if (ret == EOWNERDEAD) {
+        // 持有者在切通路和读取之间退出，mux状态不可信
+        HAL_DBG("smbus arbiter owner died, reset mux state");
+        arb->shm->mux_valid = 0;
+        pthread_mutex_consistent(&arb->shm->lock);
+        ret = 0;
+    }
+    ASSERT_FR(ret == 0, -ret, "lock smbus arbiter fail(%d)!", ret);
+    return 0;
+}
+
+void smbus_arb_unlock(smbus_arb_t *arb)
+{
+    if (arb)
+        pthread_mutex_unlock(&arb->shm->lock);
+}
+
+int smbus_arb_mux_selected(smbus_arb_t *arb, uint8_t slave, uint8_t chan)
+{
+    if (!arb)
+        return 0;
+    smbus_arb_shm_t *shm = arb->shm;
+    return shm->mux_valid && shm->mux_slave == slave && shm->mux_chan == chan;
+}
+
+void smbus_arb_mux_set(smbus_arb_t *arb, uint8_t slave, uint8_t chan)
+{
+    if (!arb)
+        return;
+    smbus_arb_shm_t *shm = arb->shm;
+    shm->mux_slave = slave;
+    shm->mux_chan = chan;
+    shm->mux_owner = getpid();
+    shm->mux_valid = 1;
+}
+
+void smbus_arb_mux_invalidate(smbus_arb_t *arb)
+{
+    if (!arb)
+        return;
+    arb->shm->mux_valid = 0;
+}
+
+pid_t smbus_arb_mux_owner(smbus_arb_t *arb)
+{
+    return arb ? __atomic_load_n(&arb->shm->mux_owner, __ATOMIC_RELAXED) : 0;
+}
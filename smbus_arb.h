@@ -0,0 +1,65 @@
+#ifndef __SXF_SMBUS_ARB_H__
+#define __SXF_SMBUS_ARB_H__
+
+#include <stdint.h>
+#include <sys/types.h>
+
+#define SMBUS_ARB_TIMEOUT_MS    1000    // 获取跨进程总线锁的最长等待时间
+
+typedef struct smbus_arb_t smbus_arb_t;
+
+/**
+ * @description: 打开总线的跨进程仲裁器，同一个i2c适配器在所有进程中共用一块共享内存
+ *               共享内存权限为0660，访问同一总线的进程需属于同一个用户组
+ *               初始化由共享内存文件的 flock 串行化，初始化者中途退出时由下一个打开者重新初始化
+ *               通路缓存只能看到经过仲裁器的切换，i2cset、内核mux驱动或mux复位改了通路时缓存不会知道，
+ *               因此通路后面的事务失败时需调用 smbus_arb_mux_invalidate，下次重新切通路
+ * @param {const char*} dev: 总线设备，例如 /dev/i2c-3
+ * @return {smbus_arb_t*} 成功: 仲裁器句柄, 失败: NULL
+ */
+smbus_arb_t *smbus_arb_open(const char *dev);
+/**
+ * @description: 关闭仲裁器，不影响其它进程
+ * @param {smbus_arb_t*} arb: 仲裁器句柄，NULL 时什么也不做
+ */
+void smbus_arb_close(smbus_arb_t *arb);
+/**
+ * @description: 获取跨进程总线锁，在切通路和之后的事务期间持有，同一线程可以嵌套获取
+ *               持有者异常退出时锁自动释放，并清空通路缓存
+ * @param {smbus_arb_t*} arb: 仲裁器句柄，NULL 时直接返回成功
+ * @return {int} 成功: 0, 超时: -ETIMEDOUT, 失败: -errno
+ */
+int smbus_arb_lock(smbus_arb_t *arb);
+/**
+ * @description: 释放跨进程总线锁
+ * @param {smbus_arb_t*} arb: 仲裁器句柄，NULL 时什么也不做
+ */
+void smbus_arb_unlock(smbus_arb_t *arb);
+/**
+ * @description: 判断总线上的mux当前是否已经切到指定通路，需持有总线锁
+ * @param {smbus_arb_t*} arb: 仲裁器句柄
+ * @param {uint8_t} slave: mux地址
+ * @param {uint8_t} chan: 通路寄存器的值
+ * @return {int} 已切好: 1, 未知或其它通路: 0
+ */
+int smbus_arb_mux_selected(smbus_arb_t *arb, uint8_t slave, uint8_t chan);
+/**
+ * @description: 切通路成功后发布mux的当前通路和切换者，需持有总线锁
+ * @param {smbus_arb_t*} arb: 仲裁器句柄
+ * @param {uint8_t} slave: mux地址
+ * @param {uint8_t} chan: 通路寄存器的值
+ */
+void smbus_arb_mux_set(smbus_arb_t *arb, uint8_t slave, uint8_t chan);
+/**
+ * @description: 切通路失败、通路后面的事务失败或状态未知时清空通路缓存，需持有总线锁
+ * @param {smbus_arb_t*} arb: 仲裁器句柄
+ */
+void smbus_arb_mux_invalidate(smbus_arb_t *arb);
+/**
+ * @description: 获取最近一次切换mux的进程
+ * @param {smbus_arb_t*} arb: 仲裁器句柄
+ * @return {pid_t} 进程号，没有记录时为0
+ */
+pid_t smbus_arb_mux_owner(smbus_arb_t *arb);
+
+#endif
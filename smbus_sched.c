@@ -0,0 +1,214 @@
+#include <base/oserror.h>
+#include <stdlib.h>
+#include <string.h>
+#include <errno.h>
+#include <time.h>
+#include <pthread.h>
+#include "hal_utils_inner.h"
+#include "smbus_sched.h"
+
+#define SMBUS_SCHED_DEV_LEN  64
+
+// 各优先级的默认截止时间
+static const uint32_t smbus_sched_deadline_ms[SMBUS_PRIO_NUM] = {
+    [SMBUS_PRIO_URGENT] = 100,
+    [SMBUS_PRIO_NORMAL] = 500,
+    [SMBUS_PRIO_BULK]   = 2000,
+};
+
+// 排队中的请求，挂在等待者自己的栈上
+typedef struct smbus_waiter_t {
+    struct smbus_waiter_t *next;
+    int prio;
+    uint64_t deadline_ns;
+    uint64_t seq;                       // 同优先级同截止时间时先来先得
+} smbus_waiter_t;
+
+struct smbus_sched_t {
+    struct smbus_sched_t *next;
+    char dev[SMBUS_SCHED_DEV_LEN];
+    int refs;
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    int busy;
+    pthread_t owner;
+    int depth;                          // 同一线程嵌套获取的层数
+    uint64_t seq;
+    smbus_waiter_t *waiters;
+    smbus_sched_stat_t stat[SMBUS_PRIO_NUM];
+};
+
+static smbus_sched_t *smbus_sched_list;
+static pthread_mutex_t smbus_sched_list_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static uint64_t smbus_sched_now_ns(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000ull + ts.tv_nsec;
+}
+
+smbus_sched_t *smbus_sched_get(const char *dev)
+{
+    ASSERT_FR(dev && strlen(dev) < SMBUS_SCHED_DEV_LEN, NULL, "Invalid argument");
+
+    pthread_mutex_lock(&smbus_sched_list_lock);
+    smbus_sched_t *s = smbus_sched_list;
+    while (s && strcmp(s->dev, dev))
+        s = s->next;
+
+    if (s) {
+        s->refs++;
+        goto out;
+    }
+
+    s = calloc(1, sizeof(smbus_sched_t));
+    if (!s) {
+        HAL_ERR("malloc fail!");
+        goto out;
+    }
+    strcpy(s->dev, dev);
+    s->refs = 1;
+    pthread_mutex_init(&s->lock, NULL);
+    // 截止时间按 CLOCK_MONOTONIC 计算
+    pthread_condattr_t attr;
+    pthread_condattr_init(&attr);
+    pthread_condattr_setclock(&attr, CLOCK_MONOTONIC);
+    pthread_cond_init(&s->cond, &attr);
+    pthread_condattr_destroy(&attr);
+    s->next = smbus_sched_list;
+    smbus_sched_list = s;
+out:
+    pthread_mutex_unlock(&smbus_sched_list_lock);
+    return s;
+}
+
+void smbus_sched_put(smbus_sched_t *s)
+{
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&smbus_sched_list_lock);
+    if (--s->refs > 0) {
+        pthread_mutex_unlock(&smbus_sched_list_lock);
+        return;
+    }
+
+    smbus_sched_t **pp = &smbus_sched_list;
+    while (*pp && *pp != s)
+        pp = &(*pp)->next;
+    if (*pp)
+        *pp = s->next;
+    pthread_mutex_unlock(&smbus_sched_list_lock);
+
+    pthread_mutex_destroy(&s->lock);
+    pthread_cond_destroy(&s->cond);
+    free(s);
+}
+
+static int smbus_waiter_before(const smbus_waiter_t *a, const smbus_waiter_t *b)
+{
+    if (a->prio != b->prio)
+        return a->prio < b->prio;
+    if (a->deadline_ns != b->deadline_ns)
+        return a->deadline_ns < b->deadline_ns;
+    return a->seq < b->seq;
+}
+
+// 调用时持有 s->lock，队列按调度顺序排列，队首就是下一个获得总线的请求
+static void smbus_waiter_insert(smbus_sched_t *s, smbus_waiter_t *w)
+{
+    smbus_waiter_t **pp = &s->waiters;
+    while (*pp && smbus_waiter_before(*pp, w))
+        pp = &(*pp)->next;
+    w->next = *pp;
+    *pp = w;
+}
+
+static void smbus_waiter_remove(smbus_sched_t *s, smbus_waiter_t *w)
+{
+    smbus_waiter_t **pp = &s->waiters;
+    while (*pp && *pp != w)
+        pp = &(*pp)->next;
+    if (*pp)
+        *pp = w->next;
+}
+
+int smbus_sched_acquire(smbus_sched_t *s, int prio, uint32_t timeout_ms)
+{
+    if (!s)
+        return 0;
+    ASSERT_FR(prio >= 0 && prio < SMBUS_PRIO_NUM, -OS_EINVAL, "Invalid argument");
+
+    pthread_mutex_lock(&s->lock);
+    if (s->busy && pthread_equal(s->owner, pthread_self())) {
+        s->depth++;
+        pthread_mutex_unlock(&s->lock);
+        return 0;
+    }
+
+    uint64_t start = smbus_sched_now_ns();
+    smbus_waiter_t w = {
+        .prio = prio,
+        .deadline_ns = start + (uint64_t)(timeout_ms ?: smbus_sched_deadline_ms[prio]) * 1000000ull,
+        .seq = s->seq++,
+    };
+    smbus_waiter_insert(s, &w);
+
+    struct timespec ts = {
+        .tv_sec = w.deadline_ns / 1000000000ull,
+        .tv_nsec = w.deadline_ns % 1000000000ull,
+    };
+    int ret = 0;
+    while (s->busy || s->waiters != &w) {
+        ret = pthread_cond_timedwait(&s->cond, &s->lock, &ts);
+        if (ret == ETIMEDOUT && (s->busy || s->waiters != &w))
+            break;
+        ret = 0;
+    }
+    smbus_waiter_remove(s, &w);
+
+    smbus_sched_stat_t *st = &s->stat[prio];
+    if (ret) {
+        st->timeouts++;
+        // 队首可能变了，唤醒其它等待者重新判断
+        pthread_cond_broadcast(&s->cond);
+        pthread_mutex_unlock(&s->lock);
+        return -ETIMEDOUT;
+    }
+
+    uint64_t wait = smbus_sched_now_ns() - start;
+    st->count++;
+    st->wait_ns += wait;
+    if (wait > st->wait_max_ns)
+        st->wait_max_ns = wait;
+
+    s->busy = 1;
+    s->owner = pthread_self();
+    s->depth = 1;
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
+
+void smbus_sched_release(smbus_sched_t *s)
+{
+    if (!s)
+        return;
+
+    pthread_mutex_lock(&s->lock);
+    if (s->busy && pthread_equal(s->owner, pthread_self()) && --s->depth == 0) {
+        s->busy = 0;
+        pthread_cond_broadcast(&s->cond);
+    }
+    pthread_mutex_unlock(&s->lock);
+}
+
+int smbus_sched_stats(smbus_sched_t *s, int prio, smbus_sched_stat_t *st)
+{
+    ASSERT_FR(s && st && prio >= 0 && prio < SMBUS_PRIO_NUM, -OS_EINVAL, "Invalid argument");
+
+    pthread_mutex_lock(&s->lock);
+    *st = s->stat[prio];
+    pthread_mutex_unlock(&s->lock);
+    return 0;
+}
@@ -0,0 +1,58 @@
+#ifndef __SXF_SMBUS_SCHED_H__
+#define __SXF_SMBUS_SCHED_H__
+
+#include <stdint.h>
+
+// 总线请求的优先级，数值越小越优先
+typedef enum {
+    SMBUS_PRIO_URGENT,      // 电源状态、告警查询
+    SMBUS_PRIO_NORMAL,      // 电源功率、电能等按需读取
+    SMBUS_PRIO_BULK,        // 温度、风扇等周期性批量读取
+    SMBUS_PRIO_NUM,
+} smbus_prio_e;
+
+// 各优先级的等待统计
+typedef struct {
+    uint64_t count;         // 获得总线的次数
+    uint64_t timeouts;      // 超过截止时间放弃的次数
+    uint64_t wait_ns;       // 累计等待时间
+    uint64_t wait_max_ns;   // 最长等待时间
+} smbus_sched_stat_t;
+
+typedef struct smbus_sched_t smbus_sched_t;
+
+/**
+ * @description: 获取总线的请求队列，同一个设备路径在进程内共用一个队列
+ * @param {const char*} dev: 总线设备，例如 /dev/i2c-3
+ * @return {smbus_sched_t*} 成功: 队列句柄, 失败: NULL
+ */
+smbus_sched_t *smbus_sched_get(const char *dev);
+/**
+ * @description: 释放 smbus_sched_get 获取的队列，最后一个使用者释放时销毁
+ * @param {smbus_sched_t*} s: 队列句柄，NULL 时什么也不做
+ */
+void smbus_sched_put(smbus_sched_t *s);
+/**
+ * @description: 排队获取总线，优先级高的先获得，同优先级截止时间早的先获得
+ *               不抢占正在进行的事务；同一线程可以嵌套获取，用于切通路+读取这样的事务序列
+ * @param {smbus_sched_t*} s: 队列句柄，NULL 时直接返回成功
+ * @param {int} prio: smbus_prio_e
+ * @param {uint32_t} timeout_ms: 最长等待时间，0表示使用该优先级的默认截止时间
+ * @return {int} 成功: 0, 超时: -ETIMEDOUT, 失败: -errno
+ */
+int smbus_sched_acquire(smbus_sched_t *s, int prio, uint32_t timeout_ms);
+/**
+ * @description: 释放总线，交给队列中优先级最高的请求
+ * @param {smbus_sched_t*} s: 队列句柄，NULL 时什么也不做
+ */
+void smbus_sched_release(smbus_sched_t *s);
+/**
+ * @description: 获取某个优先级的等待统计
+ * @param {smbus_sched_t*} s: 队列句柄
+ * @param {int} prio: smbus_prio_e
+ * @param {smbus_sched_stat_t*} st: 输出的统计
+ * @return {int} 成功: 0, 失败: -errno
+ */
+int smbus_sched_stats(smbus_sched_t *s, int prio, smbus_sched_stat_t *st);
+
+#endif
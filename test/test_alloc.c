@@ -0,0 +1,154 @@
+/*
+ * 稳定轮询不分配内存测试: 通过 --wrap 接管 malloc/calloc/realloc 计数，并把 smbus 换成内存中的假设备
+ * 预热之后连续轮询传感器和电源，期间分配次数必须为0；--wrap 只替换静态链接进来的目标文件中的调用，
+ * 共享库内部的分配不计入，hal 库需要静态链接才能一并检查
+ * 编译: gcc -O2 -I. -I<hal头文件目录> test/test_alloc.c sensor*.c psu*.c pmbus.c smbus_*.c -o test_alloc
+ *       -Wl,--wrap=malloc,--wrap=calloc,--wrap=realloc,--wrap=hal_smbus_alloc -L<hal库目录> -lhal -lpthread -lm
+ * 运行: ./test_alloc [轮询次数]，分配次数为0时返回0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include "hal_i2c.h"
+#include "sensor.h"
+
+#define ALLOC_WARMUP    20          // 预热轮询次数，覆盖池对象、型号缓存等首次使用时的分配
+#define ALLOC_POLLS     1000        // 默认的计数轮询次数
+
+void *__real_malloc(size_t size);
+void *__real_calloc(size_t nmemb, size_t size);
+void *__real_realloc(void *ptr, size_t size);
+hal_device_t *sensor_open(hal_module_t *hm, hal_family_t *family);
+
+static int counting;
+static int allocs;
+
+static void count_alloc(void)
+{
+    if (__atomic_load_n(&counting, __ATOMIC_RELAXED))
+        __atomic_fetch_add(&allocs, 1, __ATOMIC_RELAXED);
+}
+
+void *__wrap_malloc(size_t size)
+{
+    count_alloc();
+    return __real_malloc(size);
+}
+
+void *__wrap_calloc(size_t nmemb, size_t size)
+{
+    count_alloc();
+    return __real_calloc(nmemb, size);
+}
+
+void *__wrap_realloc(void *ptr, size_t size)
+{
+    count_alloc();
+    return __real_realloc(ptr, size);
+}
+
+// 假设备: 寄存器全为0，PMBus 字读取返回一个小的正功率，块读取返回型号和序列号
+static int fake_read_word(hal_smbus_t *smb, int slave, int reg, uint16_t *val)
+{
+    *val = 0x10;
+    return 0;
+}
+
+static int fake_write_r(hal_smbus_t *smb, int slave, int reg, void *buf, int len)
+{
+    return len;
+}
+
+static int fake_read_r(hal_smbus_t *smb, int slave, int reg, void *buf, int len)
+{
+    memset(buf, 0, len);
+    return len;
+}
+
+static int fake_rblock(hal_smbus_t *smb, int slave, int reg, uint8_t *buf, int len)
+{
+    return snprintf((char *)buf, len, reg == 0x9a ? "CRPS350S" : "SN%02x", slave);
+}
+
+static void fake_free(hal_smbus_t *smb)
+{
+    free(smb);
+}
+
+hal_smbus_t *__wrap_hal_smbus_alloc(const char *dev, int slave, int flags)
+{
+    hal_smbus_t *smb = calloc(1, sizeof(hal_smbus_t));
+    if (!smb)
+        return NULL;
+    smb->read_word = fake_read_word;
+    smb->write_r = fake_write_r;
+    smb->read_r = fake_read_r;
+    smb->rblock = fake_rblock;
+    smb->free = fake_free;
+    return smb;
+}
+
+static int sensor_cb(hal_data_t *data, void *priv)
+{
+    (*(int *)priv)++;
+    return 0;
+}
+
+static void poll_sensor(hal_device_sensor_t *dev, int *reports)
+{
+    sensor_snapshot_t snap;
+    dev->method->iter(dev, sensor_cb, reports);
+    sensor_iter_delta(dev, NULL, sensor_cb, reports);
+    sensor_snapshot(dev, &snap);
+}
+
+static void poll_psu(psu_object_t *psu)
+{
+    for (uint32_t idx = 0; idx < psu_count(psu); idx++) {
+        psu_status(psu, idx);
+        psu_power_input(psu, idx);
+        psu_power_output(psu, idx);
+    }
+}
+
+// 预热后计数 polls 次轮询期间的分配次数
+static int count_polls(hal_device_sensor_t *dev, psu_object_t *psu, int polls, int *reports)
+{
+    for (int i = 0; i < ALLOC_WARMUP; i++)
+        dev ? poll_sensor(dev, reports) : poll_psu(psu);
+
+    __atomic_store_n(&allocs, 0, __ATOMIC_RELAXED);
+    __atomic_store_n(&counting, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < polls; i++)
+        dev ? poll_sensor(dev, reports) : poll_psu(psu);
+    __atomic_store_n(&counting, 0, __ATOMIC_RELAXED);
+    return __atomic_load_n(&allocs, __ATOMIC_RELAXED);
+}
+
+int main(int argc, char **argv)
+{
+    int polls = argc > 1 ? atoi(argv[1]) : ALLOC_POLLS;
+    if (polls <= 0)
+        polls = ALLOC_POLLS;
+
+    hal_device_sensor_t *dev = (hal_device_sensor_t *)sensor_open(NULL, NULL);
+    if (!dev) {
+        printf("sensor_open fail\n");
+        return 1;
+    }
+    psu_object_t *psu = sensor_psu(dev);
+
+    int reports = 0;
+    int sensor_allocs = count_polls(dev, NULL, polls, &reports);
+    int psu_allocs = psu ? count_polls(NULL, psu, polls, NULL) : 0;
+    printf("sensor: %d allocations in %d polls (%d reports)\n", sensor_allocs, polls, reports);
+    printf("psu: %d allocations in %d polls of %u psu\n", psu_allocs, polls, psu ? psu_count(psu) : 0);
+
+    // 没有经过 hal 框架打开，关闭前按框架的方式设置 common.priv
+    dev->common.priv = dev->priv;
+    dev->common.close(&dev->common);
+
+    int failed = sensor_allocs || psu_allocs || !psu || !reports;
+    printf("alloc: %s\n", failed ? "FAIL" : "OK");
+    return failed ? 1 : 0;
+}
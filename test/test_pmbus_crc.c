@@ -0,0 +1,86 @@
+/*
+ * pmbus_crc8 测试: 与逐位计算的参考实现穷举比对，并测量查表实现的吞吐
+ * 编译: gcc -O2 -I. -I<hal头文件目录> test/test_pmbus_crc.c pmbus.c -o test_pmbus_crc -lpthread
+ * 运行: ./test_pmbus_crc [MB]，全部一致时返回0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <stdint.h>
+#include <time.h>
+#include "pmbus.h"
+
+#define CRC_BENCH_BUF   (1 << 20)
+
+// 逐位计算的 CRC-8，多项式 x^8+x^2+x+1(0x07)，初始值由调用者传入
+static uint8_t crc8_bitwise(uint8_t crc, const uint8_t *buf, size_t len)
+{
+    while (len--) {
+        crc ^= *buf++;
+        for (int i = 0; i < 8; i++)
+            crc = crc & 0x80 ? (uint8_t)(crc << 1) ^ 0x07 : (uint8_t)(crc << 1);
+    }
+    return crc;
+}
+
+static double now_sec(void)
+{
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return ts.tv_sec + ts.tv_nsec / 1e9;
+}
+
+int main(int argc, char *argv[])
+{
+    int bad = 0;
+
+    // 1. 穷举所有初始值和所有单字节输入，覆盖查表的每一项
+    for (int crc = 0; crc < 256; crc++) {
+        for (int d = 0; d < 256; d++) {
+            uint8_t b = d;
+            if (pmbus_crc8(crc, &b, 1) != crc8_bitwise(crc, &b, 1)) {
+                if (bad++ < 8)
+                    printf("mismatch crc 0x%02x data 0x%02x\n", crc, d);
+            }
+        }
+    }
+
+    // 2. 分段计算与一次计算结果一致，PEC 就是这样按地址、命令、数据分段累加的
+    uint8_t msg[] = { 0xb0, 0x96, 0xb1, 0x34, 0x12 };
+    uint8_t seg = pmbus_crc8(pmbus_crc8(0, msg, 2), msg + 2, sizeof(msg) - 2);
+    if (seg != pmbus_crc8(0, msg, sizeof(msg)) || seg != crc8_bitwise(0, msg, sizeof(msg))) {
+        printf("segmented crc mismatch\n");
+        bad++;
+    }
+
+    // 3. CRC-8/SMBUS 的标准校验值
+    const uint8_t check[] = "123456789";
+    if (pmbus_crc8(0, check, 9) != 0xf4) {
+        printf("check value 0x%02x, expect 0xf4\n", pmbus_crc8(0, check, 9));
+        bad++;
+    }
+    printf("crc8 exhaustive: %s\n", bad ? "FAIL" : "OK");
+
+    // 4. 吞吐，查表与逐位实现对比
+    int mb = argc > 1 ? atoi(argv[1]) : 64;
+    uint8_t *buf = malloc(CRC_BENCH_BUF);
+    if (!buf)
+        return 1;
+    for (int i = 0; i < CRC_BENCH_BUF; i++)
+        buf[i] = i * 131 + 7;
+
+    volatile uint8_t sink = 0;
+    double t = now_sec();
+    for (int i = 0; i < mb; i++)
+        sink = pmbus_crc8(sink, buf, CRC_BENCH_BUF);
+    double table = mb / (now_sec() - t);
+
+    int bmb = mb / 8 ?: 1;
+    t = now_sec();
+    for (int i = 0; i < bmb; i++)
+        sink = crc8_bitwise(sink, buf, CRC_BENCH_BUF);
+    double bitwise = bmb / (now_sec() - t);
+    printf("crc8 table %.0f MB/s, bitwise %.0f MB/s\n", table, bitwise);
+
+    free(buf);
+    return bad ? 1 : 0;
+}
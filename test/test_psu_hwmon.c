@@ -0,0 +1,192 @@
+/*
+ * psu_hwmon 后端测试: 在临时目录中伪造 /sys/class/hwmon，通过 HAL_PSU_HWMON_ROOT 指向它
+ * 编译: gcc -O2 -I. -I<hal头文件目录> test/test_psu_hwmon.c psu*.c pmbus.c smbus_*.c -o test_psu_hwmon -lpthread
+ * 运行: ./test_psu_hwmon，全部通过时返回0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+#include <fcntl.h>
+#include <pthread.h>
+#include <sys/stat.h>
+#include "psu.h"
+
+#define HWMON_CACHE_US  110000      // 超过后端100ms的缓存时间
+
+static char root[64];
+static int failed;
+
+#define CHECK(_cond, ...)                       \
+    do {                                        \
+        if (!(_cond)) {                         \
+            printf("FAIL %d: ", __LINE__);      \
+            printf(__VA_ARGS__);                \
+            printf("\n");                       \
+            failed++;                           \
+        }                                       \
+    } while (0)
+
+static void put(const char *dev, const char *attr, const char *val)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, dev, attr);
+    FILE *fp = fopen(path, "w");
+    if (!fp) {
+        perror(path);
+        exit(1);
+    }
+    fputs(val, fp);
+    fclose(fp);
+}
+
+// 不截断文件直接覆盖，并发读取的线程不会读到空文件，新旧内容需等长
+static void overwrite(const char *dev, const char *attr, const char *val)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s/%s", root, dev, attr);
+    int fd = open(path, O_WRONLY);
+    if (fd < 0 || pwrite(fd, val, strlen(val), 0) != (ssize_t)strlen(val)) {
+        perror(path);
+        exit(1);
+    }
+    close(fd);
+}
+
+// 按 pmbus 驱动的布局生成一个电源: in1/in2 为输入/输出电压，power1/power2 为输入/输出功率
+static void make_psu(const char *dev, const char *driver, const char *pin_uw, const char *pout_uw)
+{
+    char path[256];
+    snprintf(path, sizeof(path), "%s/%s", root, dev);
+    mkdir(path, 0755);
+    put(dev, "name", driver);
+    put(dev, "in1_label", "vin\n");
+    put(dev, "in1_input", "230000\n");
+    put(dev, "in2_label", "vout1\n");
+    put(dev, "in2_input", "12000\n");
+    put(dev, "in2_crit_alarm", "0\n");
+    put(dev, "power1_label", "pin\n");
+    put(dev, "power1_input", pin_uw);
+    put(dev, "power2_label", "pout1\n");
+    put(dev, "power2_input", pout_uw);
+}
+
+typedef struct {
+    psu_object_t *psu;
+    int stop;
+    int reads;
+    int bad;                // 读到的 psu1 输入功率不是写入的两个值之一的次数
+    double bad_val;
+} reader_t;
+
+static void *reader(void *priv)
+{
+    reader_t *r = priv;
+    while (!__atomic_load_n(&r->stop, __ATOMIC_RELAXED)) {
+        for (uint32_t idx = 0; idx < psu_count(r->psu); idx++) {
+            int st = psu_status(r->psu, idx);
+            double pin = psu_power_input(r->psu, idx);
+            double pout = psu_power_output(r->psu, idx);
+            int ok = st == HAL_PSU_STAT_ON;
+            if (idx == 0)
+                ok = ok && (pin == 120.5 || pin == 130) && pout == 100;
+            else
+                ok = ok && pin == 250 && pout == 220;
+            __atomic_fetch_add(&r->reads, 1, __ATOMIC_RELAXED);
+            if (!ok) {
+                __atomic_fetch_add(&r->bad, 1, __ATOMIC_RELAXED);
+                double val = idx == 0 ? pin : pout;
+                __atomic_store(&r->bad_val, &val, __ATOMIC_RELAXED);
+            }
+        }
+    }
+    return NULL;
+}
+
+int main(void)
+{
+    snprintf(root, sizeof(root), "/tmp/psu_hwmon.XXXXXX");
+    if (!mkdtemp(root)) {
+        perror("mkdtemp");
+        return 1;
+    }
+    setenv("HAL_PSU_HWMON_ROOT", root, 1);
+
+    // 注册顺序与 sysfs 顺序相反，电源序号仍按路径排序；非电源设备被跳过
+    make_psu("hwmon3", "pmbus\n", "250000000\n", "220000000\n");
+    make_psu("hwmon1", "crps\n", "120500000\n", "100000000\n");
+    char path[256];
+    snprintf(path, sizeof(path), "%s/hwmon0", root);
+    mkdir(path, 0755);
+    put("hwmon0", "name", "coretemp\n");
+
+    // 通用 pmbus 驱动绑定的VRM有输入电压和输出功率，但没有输入功率，不是电源
+    snprintf(path, sizeof(path), "%s/hwmon2", root);
+    mkdir(path, 0755);
+    put("hwmon2", "name", "pmbus\n");
+    put("hwmon2", "in1_label", "vin\n");
+    put("hwmon2", "in1_input", "12000\n");
+    put("hwmon2", "in2_label", "vout1\n");
+    put("hwmon2", "in2_input", "1800\n");
+    put("hwmon2", "power1_label", "pout1\n");
+    put("hwmon2", "power1_input", "30000000\n");
+
+    psu_object_t *psu = psu_alloc();
+    CHECK(psu, "psu_alloc picked no backend");
+    if (!psu)
+        return 1;
+
+    // 1. 电源个数和读数
+    CHECK(psu_count(psu) == 2, "psu count %u", psu_count(psu));
+    CHECK(psu_status(psu, 0) == HAL_PSU_STAT_ON, "psu1 status %d", psu_status(psu, 0));
+    CHECK(psu_power_input(psu, 0) == 120.5, "psu1 pin %g", psu_power_input(psu, 0));
+    CHECK(psu_power_output(psu, 1) == 220, "psu2 pout %g", psu_power_output(psu, 1));
+
+    // 2. 输出电压过低或电压告警时为关闭
+    put("hwmon1", "in2_input", "500\n");
+    usleep(HWMON_CACHE_US);
+    CHECK(psu_status(psu, 0) == HAL_PSU_STAT_OFF, "psu1 low vout status %d", psu_status(psu, 0));
+    put("hwmon1", "in2_input", "12000\n");
+    put("hwmon3", "in2_crit_alarm", "1\n");
+    usleep(HWMON_CACHE_US);
+    CHECK(psu_status(psu, 0) == HAL_PSU_STAT_ON, "psu1 recovered status %d", psu_status(psu, 0));
+    CHECK(psu_status(psu, 1) == HAL_PSU_STAT_OFF, "psu2 alarm status %d", psu_status(psu, 1));
+    put("hwmon3", "in2_crit_alarm", "0\n");
+    usleep(HWMON_CACHE_US);
+
+    // 3. 缓存时间内并发读取共用一次刷新，多个线程同时读到的都是写入过的值
+    reader_t r = { .psu = psu };
+    pthread_t tid[4];
+    for (int i = 0; i < 4; i++)
+        pthread_create(&tid[i], NULL, reader, &r);
+    for (int i = 0; i < 5; i++) {
+        overwrite("hwmon1", "power1_input", i & 1 ? "120500000\n" : "130000000\n");
+        usleep(HWMON_CACHE_US / 2);
+    }
+    __atomic_store_n(&r.stop, 1, __ATOMIC_RELAXED);
+    for (int i = 0; i < 4; i++)
+        pthread_join(tid[i], NULL);
+    CHECK(r.reads > 0, "no concurrent reads");
+    CHECK(r.bad == 0, "%d of %d concurrent reads wrong, last %g", r.bad, r.reads, r.bad_val);
+    overwrite("hwmon1", "power1_input", "120500000\n");
+
+    // 4. 驱动读属性失败(电源拔出)时状态和功率都返回失败，与其它后端一致
+    const char *attrs[] = { "in1_input", "in2_input", "power1_input", "power2_input" };
+    for (unsigned int i = 0; i < sizeof(attrs) / sizeof(attrs[0]); i++)
+        put("hwmon1", attrs[i], "");
+    usleep(HWMON_CACHE_US);
+    CHECK(psu_status(psu, 0) < 0, "psu1 removed status %d", psu_status(psu, 0));
+    CHECK(psu_power_input(psu, 0) < 0, "psu1 removed pin %g", psu_power_input(psu, 0));
+    CHECK(psu_power_output(psu, 0) < 0, "psu1 removed pout %g", psu_power_output(psu, 0));
+    CHECK(psu_power_input(psu, 1) == 250, "psu2 pin %g", psu_power_input(psu, 1));
+
+    psu_free(psu);
+
+    char cmd[128];
+    snprintf(cmd, sizeof(cmd), "rm -rf %s", root);
+    if (system(cmd) != 0)
+        printf("remove %s fail\n", root);
+
+    printf("psu_hwmon: %s\n", failed ? "FAIL" : "OK");
+    return failed ? 1 : 0;
+}
@@ -0,0 +1,121 @@
+/*
+ * 电源插拔识别测试: 用假后端模拟电源拔出后不应答(读状态失败)再插回，检查 redetect 只调用一次
+ * 编译: gcc -O2 -I. -I<hal头文件目录> test/test_psu_presence.c psu*.c pmbus.c smbus_*.c -o test_psu_presence -lpthread
+ * 运行: ./test_psu_presence，全部通过时返回0
+ */
+#include <stdio.h>
+#include <stdlib.h>
+#include <unistd.h>
+#include <pthread.h>
+#include <sys/eventfd.h>
+#include "psu.h"
+
+#define FAKE_NACK   -1          // 电源拔出后不应答，后端读状态失败
+#define READERS     4
+
+static int fake_stat = HAL_PSU_STAT_ON;
+static int redetects;
+static int failed;
+
+#define CHECK(_cond, ...)                       \
+    do {                                        \
+        if (!(_cond)) {                         \
+            printf("FAIL %d: ", __LINE__);      \
+            printf(__VA_ARGS__);                \
+            printf("\n");                       \
+            failed++;                           \
+        }                                       \
+    } while (0)
+
+static int fake_status(psu_object_t *psu, uint32_t idx)
+{
+    usleep(1000);
+    return __atomic_load_n(&fake_stat, __ATOMIC_RELAXED);
+}
+
+static int fake_redetect(psu_object_t *psu, uint32_t idx)
+{
+    __atomic_fetch_add(&redetects, 1, __ATOMIC_RELAXED);
+    return 0;
+}
+
+static void fake_free(psu_object_t *psu)
+{
+    free(psu);
+}
+
+static void *reader(void *priv)
+{
+    psu_object_t *psu = priv;
+    for (int i = 0; i < 20; i++)
+        psu_status(psu, 0);
+    return NULL;
+}
+
+// 多个线程同时读状态，插入只应被识别一次
+static void read_concurrently(psu_object_t *psu)
+{
+    pthread_t tid[READERS];
+    for (int i = 0; i < READERS; i++)
+        pthread_create(&tid[i], NULL, reader, psu);
+    for (int i = 0; i < READERS; i++)
+        pthread_join(tid[i], NULL);
+}
+
+static void set_stat(int st)
+{
+    __atomic_store_n(&fake_stat, st, __ATOMIC_RELAXED);
+}
+
+static void raise_alert(int fd)
+{
+    uint64_t one = 1;
+    if (write(fd, &one, sizeof(one)) != sizeof(one))
+        perror("eventfd write");
+}
+
+int main(void)
+{
+    psu_object_t *psu = psu_object_alloc(1);
+    if (!psu)
+        return 1;
+    psu->status = fake_status;
+    psu->redetect = fake_redetect;
+    psu->free = fake_free;
+
+    // 1. 轮询: 在位 -> 不应答 -> 在位
+    read_concurrently(psu);
+    CHECK(redetects == 0, "redetect on first read %d", redetects);
+    set_stat(FAKE_NACK);
+    CHECK(psu_status(psu, 0) < 0, "nack status %d", psu_status(psu, 0));
+    set_stat(HAL_PSU_STAT_ON);
+    read_concurrently(psu);
+    CHECK(redetects == 1, "poll reinsert redetect %d", redetects);
+
+    // 2. 告警模式: 拔出和插回都在告警处理中读到，期间没有 psu_status 调用
+    int efd = eventfd(0, EFD_CLOEXEC);
+    CHECK(psu_alert_enable(psu, efd, NULL) == 0, "alert enable");
+    read_concurrently(psu);
+    set_stat(FAKE_NACK);
+    raise_alert(efd);
+    CHECK(psu_alert_wait(psu, 100) > 0, "alert pull");
+    set_stat(HAL_PSU_STAT_ON);
+    raise_alert(efd);
+    CHECK(psu_alert_wait(psu, 100) > 0, "alert insert");
+    read_concurrently(psu);
+    CHECK(redetects == 2, "alert reinsert redetect %d", redetects);
+
+    // 3. 告警模式: 拔出在告警处理中读到，插回由并发的 psu_status 读到
+    set_stat(FAKE_NACK);
+    raise_alert(efd);
+    CHECK(psu_alert_wait(psu, 100) > 0, "alert pull");
+    set_stat(HAL_PSU_STAT_ON);
+    read_concurrently(psu);
+    CHECK(redetects == 3, "concurrent reinsert redetect %d", redetects);
+
+    psu_free(psu);
+    close(efd);
+
+    printf("psu_presence: %s\n", failed ? "FAIL" : "OK");
+    return failed ? 1 : 0;
+}